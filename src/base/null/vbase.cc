@@ -0,0 +1,300 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// null/vbase.cc: implementation of base graphics library with no display
+
+// configured through environment variables:
+//  MALPINX_FRAMES      stop after this many frames
+//  MALPINX_DUMP        frames to write as PPM files, e.g. "0,100-200"
+//  MALPINX_DUMP_DIR    directory for the PPM files (default: current)
+//  MALPINX_HASH        file to write a hash of every frame into
+//  MALPINX_SYNC        if nonzero, run at the normal tick rate instead
+//                      of as fast as possible
+//  MALPINX_REFRESH     refresh rate of the pretend display, in Hz; if it
+//                      is a multiple of the tick rate, interpolated frames
+//                      are drawn in between ticks when enabled
+//
+// with an upscaling filter set, every flipped frame is scaled up as it
+// would be for display, and the scaled frames are dumped. the hashes are
+// always of the frames as drawn.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "defs.hh"
+#include "render.hh"
+#include "vbase.hh"
+#include "upscale.hh"
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned long frame = 0;
+static unsigned long maxFrames = 0;
+static std::vector<std::pair<unsigned long, unsigned long>> dumpRanges;
+static std::string dumpDir = ".";
+static std::FILE *hashFile = nullptr;
+static bool sync = false;
+// frames shown per tick, and which of them is being drawn
+static int refreshesPerTick = 1;
+static int refreshIndex = 0;
+static Clock::time_point startTime, nextTick;
+// the frame as it would be shown, fade applied, and its hash; only kept
+// up to date when needed
+static Image presented(S_WIDTH, S_HEIGHT);
+static std::uint64_t presentedHash = 0;
+static bool presentedValid = false;
+// the presented frame scaled up, and how long that took
+static Upscaler *upscaler = nullptr;
+static std::vector<Color> upscaled;
+static UpscaleFilter upscaleFilter = UpscaleFilter::None;
+static int upscaleFactor = 1;
+static unsigned long upscaleCount = 0;
+static Clock::duration upscaleTotal{}, upscaleMax{};
+
+static const char *null_getenv(const char *name)
+{
+    const char *value = std::getenv(name);
+    return value && *value ? value : nullptr;
+}
+
+// parses a list such as "0,100-200,300"
+static void null_parse_ranges(const char *s)
+{
+    while (*s)
+    {
+        char *end;
+        unsigned long first = std::strtoul(s, &end, 10), last = first;
+        if (end == s)
+            break;
+        s = end;
+        if (*s == '-')
+        {
+            last = std::strtoul(++s, &end, 10);
+            s = end;
+        }
+        dumpRanges.emplace_back(first, last);
+        if (*s != ',')
+            break;
+        ++s;
+    }
+}
+
+static bool null_should_dump(unsigned long n)
+{
+    for (auto &range : dumpRanges)
+        if (range.first <= n && n <= range.second)
+            return true;
+    return false;
+}
+
+static inline int extend_color_channel(int v)
+{
+    return (v << 4) | v;
+}
+
+static void null_write_ppm(unsigned long n)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "/frame%06lu.ppm", n);
+    std::string path = dumpDir + name;
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Could not write " << path << std::endl;
+        return;
+    }
+    int width = S_WIDTH, height = S_HEIGHT;
+    const Color *src = presented.pixels();
+    if (upscaler->active())
+    {
+        width = upscaler->width(), height = upscaler->height();
+        src = upscaled.data();
+    }
+    std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+    std::vector<unsigned char> row(width * 3);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            Color c = src[y * width + x];
+            row[x * 3 + 0] = extend_color_channel(c.getR());
+            row[x * 3 + 1] = extend_color_channel(c.getG());
+            row[x * 3 + 2] = extend_color_channel(c.getB());
+        }
+        std::fwrite(row.data(), 1, row.size(), file);
+    }
+    std::fclose(file);
+}
+
+// 64-bit FNV-1a over the color bits
+static std::uint64_t null_hash()
+{
+    std::uint64_t h = 0xcbf29ce484222325ULL;
+    const Color *src = presented.pixels();
+    for (int i = 0; i < S_WIDTH * S_HEIGHT; ++i)
+    {
+        h ^= src[i].v & 0x0FFF;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+void vbase_init(Upscaler &scaler)
+{
+    if (const char *s = null_getenv("MALPINX_FRAMES"))
+        maxFrames = std::strtoul(s, nullptr, 10);
+    if (const char *s = null_getenv("MALPINX_DUMP"))
+        null_parse_ranges(s);
+    if (const char *s = null_getenv("MALPINX_DUMP_DIR"))
+        dumpDir = s;
+    if (const char *s = null_getenv("MALPINX_HASH"))
+        if (!(hashFile = std::fopen(s, "w")))
+            std::cerr << "Could not open " << s << std::endl;
+    if (const char *s = null_getenv("MALPINX_SYNC"))
+        sync = std::atoi(s) != 0;
+    if (const char *s = null_getenv("MALPINX_REFRESH"))
+        refreshesPerTick = std::max(1, std::atoi(s) / S_TICKS);
+    upscaler = &scaler;
+    startTime = nextTick = Clock::now();
+}
+
+static void null_configure_upscaler()
+{
+    upscaler->configure(upscaleFilter, upscaleFactor);
+    upscaled.resize(upscaler->width() * upscaler->height());
+}
+
+void vbase_set_scale(int scale)
+{
+    upscaleFactor = scale;
+    null_configure_upscaler();
+}
+
+void vbase_set_filter(UpscaleFilter filter)
+{
+    upscaleFilter = filter;
+    null_configure_upscaler();
+}
+
+// should game stay running?
+bool vbase_loop()
+{
+    return !maxFrames || frame < maxFrames;
+}
+
+// applies the fade to fb_back, unless that has been done already
+static void null_present()
+{
+    if (presentedValid)
+        return;
+    int fade = GetFadeLevel();
+    Color clr(fade, fade, fade);
+    const Color *src = fb_back.pixels();
+    Color *dst = presented.buffer().data();
+    for (int i = 0; i < S_WIDTH * S_HEIGHT; ++i)
+        dst[i] = fade ? src[i] - clr : src[i];
+    presentedHash = null_hash();
+    presentedValid = true;
+}
+
+static void null_upscale()
+{
+    null_present();
+    Clock::time_point start = Clock::now();
+    upscaler->scale(presented.pixels(), Color(), upscaled.data(),
+                    upscaler->width() * sizeof(Color));
+    Clock::duration time = Clock::now() - start;
+    upscaleTotal += time;
+    upscaleMax = std::max(upscaleMax, time);
+    ++upscaleCount;
+}
+
+// dumps or hashes the presented frame if asked to
+static void null_output()
+{
+    if (!hashFile && !null_should_dump(frame))
+        return;
+    null_present();
+    if (hashFile)
+        std::fprintf(hashFile, "%lu %016llx\n", frame,
+                    static_cast<unsigned long long>(presentedHash));
+    if (null_should_dump(frame))
+        null_write_ppm(frame);
+}
+
+// applies the fade to fb_back, then dumps or hashes it if asked to
+void vbase_flip()
+{
+    presentedValid = false;
+    if (upscaler->active())
+        null_upscale();
+    null_output();
+    ++frame;
+}
+
+// a repeated frame is dumped and hashed just like a flipped one
+void vbase_repeat()
+{
+    null_output();
+    ++frame;
+}
+
+// the refreshes of a tick are evenly spaced from the previous tick
+bool vbase_next_refresh(double &blend, bool wait)
+{
+    if (refreshesPerTick <= 1)
+        return false;
+    if (!wait)
+        refreshIndex = 0;
+    else if (++refreshIndex >= refreshesPerTick)
+        return false;
+    blend = static_cast<double>(refreshIndex) / refreshesPerTick;
+    return true;
+}
+
+// never late unless running at the normal tick rate
+double vbase_lateness()
+{
+    if (!sync)
+        return -1.0;
+    auto tick = std::chrono::microseconds(S_TICK_US);
+    return std::chrono::duration<double>(Clock::now() - (nextTick + tick))
+                / tick;
+}
+
+// waits for tick to expire
+void vbase_sync()
+{
+    if (!sync)
+        return;
+    nextTick += std::chrono::microseconds(S_TICK_US);
+    std::this_thread::sleep_until(nextTick);
+}
+
+void vbase_quit()
+{
+    if (hashFile)
+        std::fclose(hashFile);
+    double seconds = std::chrono::duration<double>(
+                Clock::now() - startTime).count();
+    DEBUG_LOG("Frames: ", frame, ", seconds: ", seconds,
+            ", frames per second: ", seconds > 0 ? frame / seconds : 0.0);
+    if (upscaleCount)
+        DEBUG_LOG("Upscaled ", upscaleCount, " frames to ",
+                upscaler->width(), "x", upscaler->height(), " with the ",
+                GetUpscaleFilterName(upscaleFilter), " filter: ",
+                std::chrono::duration<double, std::micro>(
+                    upscaleTotal / upscaleCount).count(), " us mean, ",
+                std::chrono::duration<double, std::micro>(
+                    upscaleMax).count(), " us max");
+    upscaler = nullptr;
+}
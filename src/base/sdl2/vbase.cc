@@ -6,20 +6,95 @@
 /****************************************************************************/
 // sdl2/vbase.cc: implementation of base graphics library on SDL2
 
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <SDL2/SDL.h>
 #include "defs.hh"
 #include "render.hh"
 #include "base/sdl2.hh"
+#include "blit.hh"
+#include "upscale.hh"
 #include "main.hh"
 
 static SDL_Window *window;
 static SDL_Renderer *renderer;
 static SDL_Surface *surface;
 static SDL_Texture *screen;
+// scales frames up before they are uploaded if a filter is set; owned by
+// the backend and only used by whichever thread shows the frames. frames
+// converted through the palette are scaled up into upscaled first.
+static Upscaler *upscaler = nullptr;
+static std::vector<Color> upscaled;
+// the filter and scale asked for, taken up by the presentation thread
+// before the next frame it shows
+static UpscaleFilter upscaleFilter = UpscaleFilter::None;
+static int upscaleFactor = 1;
+static bool upscaleChanged = false;
 static bool quit = false;
-static Uint32 palette[0x1000];
-static unsigned int ticks = 0;
-static unsigned long long frac = 0ULL;
+// true if fb_back can be uploaded as is into an RGB444 texture
+static bool direct = false;
+// one palette bank per global fade level
+static Uint32 palette[S_COLORS][0x1000];
+// frame pacer: the time of the next tick and the length of a tick, in
+// performance counter units
+static Uint64 pacerNext = 0;
+static Uint64 pacerTick = 0;
+// sleeping is only accurate to about this much; the rest is spun
+constexpr unsigned long long PACER_SPIN_US = 500;
+// if the game falls this many ticks behind, it is not made to catch up
+constexpr int PACER_MAX_LAG = 4;
+// how much later than planned the ticks started, in microseconds
+static unsigned long long jitterTotal = 0, jitterMax = 0;
+static unsigned long pacerTicks = 0, pacerLate = 0;
+
+// the renderer lives on the presentation thread, so that a late vsync in
+// SDL_RenderPresent never holds up the game loop. frames are passed to it
+// through three buffers: one written by vbase_flip, one ready and one shown.
+// SDL only supports rendering from a thread other than the one that made
+// the window with the X11 and Wayland video drivers, so this is only done
+// when one of those is in use; with any other driver, or if the renderer
+// cannot be made on that thread, vbase_flip shows each frame itself.
+struct PresentFrame
+{
+    std::vector<Color> pixels;
+    int fade;
+};
+static PresentFrame frames[3];
+static bool presentThreaded = false;
+static int writeFrame = 0, readyFrame = 1, shownFrame = 2;
+// true if readyFrame has not been shown yet
+static bool frameReady = false;
+static bool presentQuit = false;
+static std::thread presentThread;
+static std::mutex presentMutex;
+static std::condition_variable presentWake;
+// set by the presentation thread once the renderer has been created, and
+// if it could not be made or the thread has stopped, why
+static bool presentStarted = false;
+static std::string presentError;
+// frames replaced before they were shown, and refreshes that showed the
+// same frame again
+static unsigned long framesShown = 0, framesDropped = 0, framesRepeated = 0;
+// measured time between vsyncs, in performance counter units, and whether
+// vsync runs close enough to the tick rate to pace the game instead
+static bool rendererVsync = false;
+static std::atomic<Uint64> vsyncPeriod{0};
+static std::atomic<bool> vsyncPacing{false};
+// when the last vsynced present returned, and the refresh the latest
+// interpolated frame was meant for
+static std::atomic<Uint64> lastVsync{0};
+static Uint64 refreshTarget = 0;
+// the period assumed until it is measured, when the last frame was
+// presented, and how many periods have been measured
+static Uint64 presentPeriod = 0, presentLast = 0;
+static int presentMeasured = 0;
 
 int SDL_main(int argc, char **argv)
 {
@@ -34,46 +109,303 @@ static inline int extend_color_channel(int v)
 void sdl_build_palette()
 {
     Color clr;
-    for (int i = 0; i < 0x1000; ++i)
+    for (int f = 0; f < S_COLORS; ++f)
     {
-        clr = Color(i);
-        palette[i] = SDL_MapRGB(surface->format,
-            extend_color_channel(clr.getR()),
-            extend_color_channel(clr.getG()),
-            extend_color_channel(clr.getB()));
+        Color fade(f, f, f);
+        for (int i = 0; i < 0x1000; ++i)
+        {
+            clr = Color(i) - fade;
+            palette[f][i] = SDL_MapRGB(surface->format,
+                extend_color_channel(clr.getR()),
+                extend_color_channel(clr.getG()),
+                extend_color_channel(clr.getB()));
+        }
     }
 }
 
-void vbase_init()
+// can the renderer use textures of this format without converting them?
+static bool sdl_renderer_has_format(Uint32 format)
+{
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info))
+        return false;
+    for (Uint32 i = 0; i < info.num_texture_formats; ++i)
+        if (info.texture_formats[i] == format)
+            return true;
+    return false;
+}
+
+// Color is 0x8RGB, which RGB444 reads as is (the top 4 bits are ignored)
+static bool sdl_init_direct()
+{
+    static_assert(sizeof(Color) == sizeof(Uint16));
+    if (!sdl_renderer_has_format(SDL_PIXELFORMAT_RGB444))
+        return false;
+    screen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB444,
+                    SDL_TEXTUREACCESS_STREAMING, S_WIDTH, S_HEIGHT);
+    return screen != nullptr;
+}
+
+static void sdl_init_palette()
 {
-    if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_VIDEO))
-        throw SDLException("Could not initialize SDL2");
-    if (!(window = SDL_CreateWindow("MALPINX", 50, 50,
-                    S_WIDTH, S_HEIGHT, SDL_WINDOW_SHOWN)))
-        throw SDLException("Could not initialize SDL2 window");
-    if (!(renderer = SDL_CreateRenderer(window, -1,
-                    SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC)))
-        throw SDLException("Could not initialize SDL2 renderer");
     if (!(surface = SDL_CreateRGBSurface(0, S_WIDTH, S_HEIGHT, 32,
                     0, 0, 0, 0)))
         throw SDLException("Could not initialize SDL2 surface");
     if (!(screen = SDL_CreateTextureFromSurface(renderer, surface)))
         throw SDLException("Could not initialize SDL2 texture");
-    ticks = SDL_GetTicks();
     sdl_build_palette();
+}
+
+static void sdl_init_renderer()
+{
+    if (!(renderer = SDL_CreateRenderer(window, -1,
+                    SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC)))
+        throw SDLException("Could not initialize SDL2 renderer");
+    direct = sdl_init_direct();
+    if (!direct)
+        sdl_init_palette();
+    DEBUG_LOG("Using ", direct ? "RGB444" : "palette", " screen texture");
+    SDL_RendererInfo info;
+    rendererVsync = !SDL_GetRendererInfo(renderer, &info)
+                    && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+}
+
+static void sdl_quit_renderer()
+{
+    SDL_DestroyTexture(screen);
+    SDL_FreeSurface(surface);
+    SDL_DestroyRenderer(renderer);
+    screen = nullptr;
+    surface = nullptr;
+    renderer = nullptr;
+}
+
+// remakes the screen texture, and the surface for palette conversion,
+// at the size of the frames as they are uploaded
+static bool sdl_resize_screen(int width, int height)
+{
+    SDL_DestroyTexture(screen);
+    screen = nullptr;
+    if (direct)
+        screen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB444,
+                    SDL_TEXTUREACCESS_STREAMING, width, height);
+    else
+    {
+        SDL_FreeSurface(surface);
+        if ((surface = SDL_CreateRGBSurface(0, width, height, 32,
+                        0, 0, 0, 0)))
+            screen = SDL_CreateTextureFromSurface(renderer, surface);
+    }
+    return screen != nullptr;
+}
+
+// if the screen texture cannot be made that large, frames are shown as
+// they are instead; false if there is no screen texture left at all
+static bool sdl_configure_upscaler(UpscaleFilter filter, int factor)
+{
+    upscaler->configure(filter, factor);
+    if (!upscaler->active())
+        upscaled.clear();
+    else if (!direct)
+        upscaled.resize(upscaler->width() * upscaler->height());
+    int width = upscaler->width(), height = upscaler->height();
+    if (sdl_resize_screen(width, height))
+    {
+        if (upscaler->active())
+            DEBUG_LOG("Upscaling to ", width, "x", height, " with the ",
+                    GetUpscaleFilterName(filter), " filter");
+        return true;
+    }
+    DEBUG_LOG("Could not make a ", width, "x", height, " screen texture");
+    upscaler->configure(UpscaleFilter::None, 1);
+    upscaled.clear();
+    if (sdl_resize_screen(S_WIDTH, S_HEIGHT))
+        return true;
+    std::lock_guard<std::mutex> lock(presentMutex);
+    presentError = SDL2_build_message("Could not initialize SDL2 texture");
+    return false;
+}
+
+static void sdl_upload_direct(const PresentFrame &frame);
+static void sdl_upload_palette(const PresentFrame &frame);
+
+// length of one display refresh in performance counter units
+static Uint64 sdl_refresh_period()
+{
+    SDL_DisplayMode mode;
+    int rate = 60;
+    if (!SDL_GetWindowDisplayMode(window, &mode) && mode.refresh_rate > 0)
+        rate = mode.refresh_rate;
+    return SDL_GetPerformanceFrequency() / rate;
+}
+
+// if vsync is within a percent of the tick rate, ticks are made as long as
+// refreshes, so that the two do not drift apart and stutter
+static void sdl_check_vsync_pacing(Uint64 period)
+{
+    Uint64 tick = SDL_GetPerformanceFrequency() * S_TICK_US / 1000000ULL;
+    Uint64 diff = period > tick ? period - tick : tick - period;
+    vsyncPacing = diff * 100 < tick;
+    DEBUG_LOG("Refresh period ", period * 1000000ULL
+                / SDL_GetPerformanceFrequency(), " us, ",
+            vsyncPacing ? "pacing to vsync" : "pacing to timer");
+}
+
+// uploads and presents a frame, on whichever thread owns the renderer
+static void sdl_show_frame(const PresentFrame &frame)
+{
+    if (direct)
+        sdl_upload_direct(frame);
+    else
+        sdl_upload_palette(frame);
+    SDL_RenderCopy(renderer, screen, NULL, NULL);
+    SDL_RenderPresent(renderer);
+
+    // the previous frame stayed up for this many refreshes
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 period = presentPeriod;
+    if (rendererVsync)
+        lastVsync = now;
+    if (presentLast && period)
+    {
+        Uint64 interval = now - presentLast;
+        Uint64 refreshes = (interval + period / 2) / period;
+        if (refreshes > 1)
+            framesRepeated += refreshes - 1;
+        // presents one refresh apart measure the real refresh rate
+        if (rendererVsync && refreshes == 1)
+        {
+            period = presentMeasured ? (period * 15 + interval) / 16
+                                     : interval;
+            presentPeriod = vsyncPeriod = period;
+            if (++presentMeasured == S_TICKS)
+                sdl_check_vsync_pacing(period);
+        }
+    }
+    presentLast = now;
+    ++framesShown;
+}
+
+static void sdl_present_loop()
+{
+    std::string error;
+    try
+    {
+        sdl_init_renderer();
+    }
+    catch (const SDLException &e)
+    {
+        error = e.what();
+        sdl_quit_renderer();
+    }
+    {
+        std::lock_guard<std::mutex> lock(presentMutex);
+        presentError = error;
+        presentStarted = true;
+    }
+    presentWake.notify_all();
+    if (!error.empty())
+        return;
+
+    UpscaleFilter filter = UpscaleFilter::None;
+    int factor = 1;
+    bool reconfigure;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(presentMutex);
+            presentWake.wait(lock, [] { return frameReady || presentQuit; });
+            if (presentQuit)
+                break;
+            std::swap(readyFrame, shownFrame);
+            frameReady = false;
+            reconfigure = upscaleChanged;
+            filter = upscaleFilter;
+            factor = upscaleFactor;
+            upscaleChanged = false;
+        }
+        // the main thread finds out about an error on its next flip
+        if (reconfigure && !sdl_configure_upscaler(filter, factor))
+            break;
+        sdl_show_frame(frames[shownFrame]);
+    }
+    sdl_quit_renderer();
+}
+
+// false if the renderer could not be made on the presentation thread
+static bool sdl_start_present_thread()
+{
+    const char *driver = SDL_GetCurrentVideoDriver();
+    if (!driver || (std::strcmp(driver, "x11")
+                 && std::strcmp(driver, "wayland")))
+    {
+        DEBUG_LOG("Presenting on the main thread: video driver ",
+                  driver ? driver : "unknown");
+        return false;
+    }
+    presentThread = std::thread(sdl_present_loop);
+    std::string error;
+    {
+        std::unique_lock<std::mutex> lock(presentMutex);
+        presentWake.wait(lock, [] { return presentStarted; });
+        std::swap(error, presentError);
+    }
+    if (error.empty())
+        return true;
+    presentThread.join();
+    DEBUG_LOG("Presenting on the main thread: ", error);
+    return false;
+}
+
+void vbase_init(Upscaler &scaler)
+{
+    if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_VIDEO))
+        throw SDLException("Could not initialize SDL2");
+    if (!(window = SDL_CreateWindow("MALPINX", 50, 50,
+                    S_WIDTH, S_HEIGHT, SDL_WINDOW_SHOWN)))
+        throw SDLException("Could not initialize SDL2 window");
+    for (PresentFrame &frame : frames)
+        frame = { std::vector<Color>(S_WIDTH * S_HEIGHT), 0 };
+    upscaler = &scaler;
+    presentThreaded = sdl_start_present_thread();
+    if (!presentThreaded)
+        sdl_init_renderer();
+    presentPeriod = sdl_refresh_period();
+    pacerTick = SDL_GetPerformanceFrequency() * S_TICK_US / 1000000ULL;
+    pacerNext = SDL_GetPerformanceCounter() + pacerTick;
     SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
 }
 
 void vbase_set_scale(int scale)
 {
-    if (scale > 0)
-        SDL_SetWindowSize(window, S_WIDTH * scale, S_HEIGHT * scale);
+    if (scale <= 0)
+        return;
+    SDL_SetWindowSize(window, S_WIDTH * scale, S_HEIGHT * scale);
+    std::lock_guard<std::mutex> lock(presentMutex);
+    upscaleFactor = scale;
+    upscaleChanged = true;
+}
+
+void vbase_set_filter(UpscaleFilter filter)
+{
+    std::lock_guard<std::mutex> lock(presentMutex);
+    upscaleFilter = filter;
+    upscaleChanged = true;
+}
+
+// throws the error that stopped the presentation thread, if it has
+static void sdl_check_present_error()
+{
+    std::lock_guard<std::mutex> lock(presentMutex);
+    if (!presentError.empty())
+        throw std::runtime_error(presentError);
 }
 
 // should game stay running?
 bool vbase_loop()
 {
     if (quit) return false;
+    sdl_check_present_error();
     ibase_before_events();
     SDL_Event event;
     while (SDL_PollEvent(&event)) 
@@ -83,6 +415,12 @@ bool vbase_loop()
         case SDL_QUIT:
             quit = true;
             break;
+        case SDL_WINDOWEVENT:
+            // the window may have lost what was shown on it
+            if (event.window.event == SDL_WINDOWEVENT_EXPOSED
+                    || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                InvalidateFrame();
+            break;
         case SDL_KEYDOWN:
         case SDL_KEYUP:
         case SDL_CONTROLLERBUTTONDOWN:
@@ -94,42 +432,185 @@ bool vbase_loop()
     return !quit;
 }
 
-// renders screen
-void vbase_flip()
+// copies the frame into the texture, no conversion needed
+static void sdl_upload_direct(const PresentFrame &frame)
+{
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(screen, NULL, &pixels, &pitch))
+        return;
+    const Color *src = frame.pixels.data();
+    Uint8 *dst = static_cast<Uint8 *>(pixels);
+    constexpr int row = S_WIDTH * sizeof(Color);
+    if (upscaler->active())
+        upscaler->scale(src, Color(frame.fade, frame.fade, frame.fade),
+                        dst, pitch);
+    else if (frame.fade)
+    {
+        Color clr(frame.fade, frame.fade, frame.fade);
+        for (int y = 0; y < S_HEIGHT; ++y)
+            ColorRowCopySubtract(reinterpret_cast<Color *>(dst + y * pitch),
+                    src + y * S_WIDTH, S_WIDTH, clr);
+    }
+    else if (pitch == row)
+        std::memcpy(dst, src, row * S_HEIGHT);
+    else
+        for (int y = 0; y < S_HEIGHT; ++y)
+            std::memcpy(dst + y * pitch, src + y * S_WIDTH, row);
+    SDL_UnlockTexture(screen);
+}
+
+// converts the frame through the palette bank of its fade level
+static void sdl_upload_palette(const PresentFrame &frame)
 {
+    const Color *src = frame.pixels.data();
+    int width = S_WIDTH, height = S_HEIGHT;
+    // the palette bank applies the fade
+    if (upscaler->active())
+    {
+        width = upscaler->width(), height = upscaler->height();
+        upscaler->scale(src, Color(), upscaled.data(), width * sizeof(Color));
+        src = upscaled.data();
+    }
     SDL_LockSurface(surface);
     int stride = surface->pitch / sizeof(Uint32);
-    Color *src = fb_front.buffer().data();
+    const Uint32 *bank = palette[frame.fade];
     Uint32 *dst = static_cast<Uint32 *>(surface->pixels);
-    for (int y = 0; y < S_HEIGHT; ++y)
-        for (int x = 0; x < S_WIDTH; ++x)
-            dst[y * stride + x] = palette[src[y * S_STRIDE + x].v & 0x0FFF];
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            dst[y * stride + x] = bank[src[y * width + x].v & 0x0FFF];
     SDL_UpdateTexture(screen, NULL, surface->pixels, surface->pitch);
     SDL_UnlockSurface(surface);
-    SDL_RenderCopy(renderer, screen, NULL, NULL);
-    SDL_RenderPresent(renderer);
 }
 
-// waits for tick to pass
-void vbase_sync()
+// hands fb_back over to the presentation thread, or shows it right away
+// if there is none
+void vbase_flip()
 {
-    static unsigned int new_ticks;
-    while (frac < S_TICK_US)
+    PresentFrame &frame = frames[writeFrame];
+    const Color *src = fb_back.pixels();
+    for (int y = 0; y < S_HEIGHT; ++y)
+        std::memcpy(frame.pixels.data() + y * S_WIDTH, src + y * S_STRIDE,
+                    S_WIDTH * sizeof(Color));
+    frame.fade = GetFadeLevel();
+    if (!presentThreaded)
     {
-        new_ticks = SDL_GetTicks();
-        frac += 1000ULL * (new_ticks - ticks);
-        ticks = new_ticks;
-        SDL_Delay(2);
+        if (upscaleChanged)
+        {
+            upscaleChanged = false;
+            if (!sdl_configure_upscaler(upscaleFilter, upscaleFactor))
+                sdl_check_present_error();
+        }
+        sdl_show_frame(frame);
+        return;
     }
+    {
+        std::lock_guard<std::mutex> lock(presentMutex);
+        if (!presentError.empty())
+            throw std::runtime_error(presentError);
+        if (frameReady)
+            ++framesDropped;
+        std::swap(writeFrame, readyFrame);
+        frameReady = true;
+    }
+    presentWake.notify_one();
+}
+
+// the presentation thread keeps showing the last frame it was given
+void vbase_repeat()
+{
+}
+
+// sleeps, then spins until the performance counter reaches until
+static Uint64 sdl_wait_until(Uint64 until)
+{
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 spin = freq * PACER_SPIN_US / 1000000ULL;
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now + spin < until)
+        std::this_thread::sleep_for(std::chrono::microseconds(
+                (until - now - spin) * 1000000ULL / freq));
+    while ((now = SDL_GetPerformanceCounter()) < until)
+        ;
+    return now;
+}
 
-    frac %= S_TICK_US;
+// finds the next refresh that a frame flipped now would still make, as
+// predicted from the last vsync. frames are only interpolated if the
+// display refreshes at least a quarter faster than the tick rate.
+bool vbase_next_refresh(double &blend, bool wait)
+{
+    Uint64 period = vsyncPeriod, last = lastVsync;
+    if (!period || !last || period * 5 > pacerTick * 4)
+        return false;
+    Uint64 start = pacerNext - pacerTick;
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 earliest = now + period / 2;
+    if (wait)
+        earliest = std::max(earliest, refreshTarget + period);
+    Uint64 refresh = last;
+    if (earliest > last)
+        refresh += (earliest - last + period - 1) / period * period;
+    // that refresh belongs to the frame of the next tick
+    if (refresh + period / 2 >= pacerNext)
+        return false;
+    if (wait)
+        sdl_wait_until(refresh - period / 2);
+    refreshTarget = refresh;
+    blend = refresh > start
+                ? static_cast<double>(refresh - start) / pacerTick : 0.0;
+    return true;
+}
+
+double vbase_lateness()
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    return now >= pacerNext
+        ? static_cast<double>(now - pacerNext) / pacerTick
+        : -static_cast<double>(pacerNext - now) / pacerTick;
+}
+
+// waits for tick to pass. ticks are a fixed length apart, so time lost
+// waking up late is made up for by the next tick.
+void vbase_sync()
+{
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 now = sdl_wait_until(pacerNext);
+
+    unsigned long long late = (now - pacerNext) * 1000000ULL / freq;
+    jitterTotal += late;
+    jitterMax = std::max(jitterMax, late);
+    ++pacerTicks;
+    if (late > S_TICK_US / 2)
+        ++pacerLate;
+
+    if (vsyncPacing)
+        pacerTick = vsyncPeriod;
+    pacerNext += pacerTick;
+    // after a long stall, start over instead of running ticks back to back
+    if (now > pacerNext + PACER_MAX_LAG * pacerTick)
+        pacerNext = now + pacerTick;
 }
 
 void vbase_quit()
 {
-    SDL_DestroyTexture(screen);
-    SDL_FreeSurface(surface);
-    SDL_DestroyRenderer(renderer);
+    if (presentThreaded)
+    {
+        {
+            std::lock_guard<std::mutex> lock(presentMutex);
+            presentQuit = true;
+        }
+        presentWake.notify_one();
+        presentThread.join();
+    }
+    else
+        sdl_quit_renderer();
+    upscaler = nullptr;
+    DEBUG_LOG("Frames shown: ", framesShown, ", dropped: ", framesDropped,
+            ", repeated: ", framesRepeated);
+    if (pacerTicks)
+        DEBUG_LOG("Tick jitter: ", jitterTotal / pacerTicks, " us mean, ",
+                jitterMax, " us max, ", pacerLate, " ticks late");
     SDL_DestroyWindow(window);
     SDL_Quit();
 }
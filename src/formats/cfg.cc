@@ -18,6 +18,9 @@ ConfigFile::ConfigFile(std::istream &stream) : ConfigFile()
     int pos;
     while (std::getline(stream, line))
     {
+        // the file may have been written with CRLF line endings
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
         if (line.empty() || line.at(0) == '#')
             continue;
         pos = line.find("=");
@@ -35,6 +38,11 @@ void ConfigFile::write(std::ostream &stream)
         stream << pair.first << "=" << pair.second << std::endl;
 }
 
+bool ConfigFile::has(const std::string &key) const
+{
+    return keys.find(key) != keys.end();
+}
+
 bool ConfigFile::get(const std::string &key, bool fallback)
 {
     auto it = keys.find(key);
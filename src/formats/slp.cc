@@ -23,6 +23,44 @@ inline std::string SLP_build_message(const std::string& message,
     return stream.str();
 }
 
+constexpr int SLP_PLANE_BACKGROUND = 0;
+constexpr int SLP_PLANE_TERRAIN = 1;
+constexpr int SLP_PLANE_FOREGROUND = 2;
+
+// kinds 0 and 1 are images and tilemaps tiled in both directions; only
+// those and kind 2 can be used for terrain, which sprites collide with
+inline bool SLP_describe_layer(int kind, int meta, LayerDescriptor &desc)
+{
+    switch (kind)
+    {
+    case 0x0:
+    case 0x1:
+        break;
+    case 0x2:
+        desc.tiling = LayerTiling::None;
+        break;
+    case 0x3:
+        desc.tiling = LayerTiling::Horizontal;
+        break;
+    case 0x4:
+        desc.tiling = LayerTiling::HorizontalWrapped;
+        desc.blend = LayerBlend::Additive;
+        break;
+    case 0x5:
+        desc.tiling = LayerTiling::Horizontal;
+        desc.rowEffect = LayerRowEffect::Parallax;
+        desc.reverse = meta != 0;
+        break;
+    case 0x6:
+        desc.tiling = LayerTiling::Horizontal;
+        desc.rowEffect = LayerRowEffect::Wave;
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
 Stage LoadStage(const std::string &path, Shooter &stg)
 {
     auto stream = OpenDataFile(path + ".slp");
@@ -60,108 +98,57 @@ Stage LoadStage(const std::string &path, Shooter &stg)
         ReadUInt32(stream);
         ReadUInt32(stream);
 
-        switch (layerType >> 4)
+        LayerDescriptor desc;
+        desc.scrollXMul = layerXMult;
+        desc.scrollYMul = layerYMult;
+        desc.offsetX = offsetX;
+        desc.offsetY = offsetY;
+        // the high nibble is the kind of layer, the low one where it goes
+        int kind = layerType >> 4, plane = layerType & 15;
+        if (plane > SLP_PLANE_FOREGROUND
+                || !SLP_describe_layer(kind, layerMeta, desc)
+                || (plane == SLP_PLANE_TERRAIN && kind > 2))
+            continue;
+
+        std::shared_ptr<TileStrip> tiles;
+        std::shared_ptr<Image> image;
+        if (kind == 1)
         {
-        case 1:
             tilemap = std::make_shared<Tilemap>(
                         LoadTilemap(filename, tilemapSheetName));
-            break;
+            tiles = std::make_shared<TileStrip>(
+                        std::make_shared<Spritesheet>(
+                            LoadSpritesheet(tilemapSheetName)),
+                        tilemap);
         }
+        else
+            image = std::make_shared<Image>(LoadPIC(filename));
 
-        switch (layerType)
+        switch (plane)
         {
-        case 0x00:
-            stage.backgroundLayers.push_back(
-                std::make_unique<BackgroundLayer>(
-                    std::make_shared<Image>(LoadPIC(filename)),
-                    offsetX, offsetY, layerXMult, layerYMult));
-            break;
-        case 0x10:
-            stage.backgroundLayers.push_back(
-                std::make_unique<BackgroundTileLayer>(
-                    std::make_shared<Spritesheet>(
-                        LoadSpritesheet(tilemapSheetName)),
-                    tilemap,
-                    offsetX, offsetY, layerXMult, layerYMult));
-            break;
-        case 0x20:
-            stage.backgroundLayers.push_back(
-                std::make_unique<NonTiledBackgroundLayer>(
-                    std::make_shared<Image>(LoadPIC(filename)),
-                    offsetX, offsetY, layerXMult, layerYMult));
-            break;
-        case 0x30:
-            stage.backgroundLayers.push_back(
-                std::make_unique<HTiledBackgroundLayer>(
-                    std::make_shared<Image>(LoadPIC(filename)),
-                    offsetX, offsetY, layerXMult, layerYMult));
+        case SLP_PLANE_BACKGROUND:
+            stage.backgroundLayers.push_back(tiles
+                ? std::make_unique<BackgroundLayer>(tiles, desc)
+                : std::make_unique<BackgroundLayer>(image, desc));
             break;
-        case 0x40:
-            stage.backgroundLayers.push_back(
-                std::make_unique<HTiledAdditiveBackgroundLayer>(
-                    std::make_shared<Image>(LoadPIC(filename)),
-                    offsetX, offsetY, layerXMult, layerYMult));
+        case SLP_PLANE_TERRAIN:
+            stage.terrainLayers.push_back(tiles
+                ? std::make_unique<ForegroundLayer>(tiles, desc)
+                : std::make_unique<ForegroundLayer>(image, desc));
             break;
-        case 0x50:
-            stage.backgroundLayers.push_back(
-                std::make_unique<HTiledParallaxBackgroundLayer>(
-                    std::make_shared<Image>(LoadPIC(filename)),
-                    offsetX, offsetY, layerXMult, layerYMult, layerMeta));
+        case SLP_PLANE_FOREGROUND:
+            stage.foregroundLayers.push_back(tiles
+                ? std::make_unique<BackgroundLayer>(tiles, desc)
+                : std::make_unique<BackgroundLayer>(image, desc));
             break;
-        case 0x60:
-            stage.backgroundLayers.push_back(
-                std::make_unique<HTiledWavyBackgroundLayer>(
-                    std::make_shared<Image>(LoadPIC(filename)),
-                    offsetX, offsetY, layerXMult, layerYMult, layerMeta));
-            break;
-
-        case 0x01:
-            stage.terrainLayers.push_back(
-                std::make_unique<ForegroundLayer>(
-                    std::make_shared<Image>(LoadPIC(filename)),
-                    offsetX, offsetY, layerXMult, layerYMult));
-            break;
-        case 0x11:
-            stage.terrainLayers.push_back(
-                std::make_unique<ForegroundTileLayer>(
-                    std::make_shared<Spritesheet>(
-                        LoadSpritesheet(tilemapSheetName)),
-                    tilemap,
-                    offsetX, offsetY, layerXMult, layerYMult));
-            break;
-        case 0x21:
-            stage.terrainLayers.push_back(
-                std::make_unique<NonTiledForegroundLayer>(
-                    std::make_shared<Image>(LoadPIC(filename)),
-                    offsetX, offsetY, layerXMult, layerYMult));
-            break;
-
-        case 0x02:
-            stage.foregroundLayers.push_back(
-                std::make_unique<BackgroundLayer>(
-                    std::make_shared<Image>(LoadPIC(filename)),
-                    offsetX, offsetY, layerXMult, layerYMult));
-            break;
-        case 0x12:
-            stage.foregroundLayers.push_back(
-                std::make_unique<BackgroundTileLayer>(
-                    std::make_shared<Spritesheet>(
-                        LoadSpritesheet(tilemapSheetName)),
-                    tilemap,
-                    offsetX, offsetY, layerXMult, layerYMult));
-            break;
-        case 0x22:
-            stage.foregroundLayers.push_back(
-                std::make_unique<NonTiledBackgroundLayer>(
-                    std::make_shared<Image>(LoadPIC(filename)),
-                    offsetX, offsetY, layerXMult, layerYMult));
-            break;
-
-        default:
-            continue;
         }
     }
 
+    // lets the compositor skip what the layers hide of each other
+    for (auto &layer : stage.backgroundLayers)
+        layer->analyzeOpacity();
+    stage.buildCompositors();
+
     stage.levelHeight = levelHeight;
     stage.spawnLevelY = spawnLevelY;
 
@@ -20,6 +20,17 @@ inline std::string TIP_build_message(const std::string& message,
     return stream.str();
 }
 
+// rows of each frame in the atlas start on a multiple of this many pixels
+constexpr int TIP_ROW_ALIGN = 8;
+
+struct TIPFrame
+{
+    std::size_t offset;
+    int width;
+    int height;
+    int stride;
+};
+
 Spritesheet LoadSpritesheet(const std::string &path)
 {
     auto stream = OpenDataFile(path + ".tip");
@@ -36,30 +47,46 @@ Spritesheet LoadSpritesheet(const std::string &path)
 
     std::vector<std::shared_ptr<Image>> images;
     int sprites = ReadUInt16(stream);
-    int width, height, size;
+    int width, height, stride;
+    std::size_t offset;
     std::array<Color, 256> palette;
 
     if (shared)
         for (int i = 0; i < 256; ++i)
             palette[i] = Color(ReadUInt16(stream));
 
+    // all frames are stored one after another in a single buffer
+    auto atlas = std::make_shared<std::vector<Color>>();
+    std::vector<TIPFrame> frames;
+    frames.reserve(sprites);
     for (int i = 0; i < sprites; ++i)
     {
-        std::vector<Color> colors;
         width = ReadUInt16(stream);
         height = ReadUInt16(stream);
-        size = width * height;
-        colors.reserve(size);
+        stride = (width + TIP_ROW_ALIGN - 1) & ~(TIP_ROW_ALIGN - 1);
+        offset = atlas->size();
+        atlas->resize(offset + stride * height);
 
-        if (shared)
-            for (int j = 0; j < size; ++j)
-                colors.push_back(palette[ReadUInt8(stream)]);
-        else
-            for (int j = 0; j < size; ++j)
-                colors.push_back(Color(ReadUInt16(stream)));
+        Color *row = atlas->data() + offset;
+        for (int y = 0; y < height; ++y, row += stride)
+        {
+            if (shared)
+                for (int x = 0; x < width; ++x)
+                    row[x] = palette[ReadUInt8(stream)];
+            else
+                for (int x = 0; x < width; ++x)
+                    row[x] = Color(ReadUInt16(stream));
+        }
+        frames.push_back({ offset, width, height, stride });
+    }
 
-        images.push_back(std::make_shared<Image>(width, height,
-                         std::move(colors)));
+    images.reserve(sprites);
+    for (const TIPFrame &frame : frames)
+    {
+        auto image = std::make_shared<Image>(atlas, frame.offset,
+                         frame.width, frame.height, frame.stride);
+        image->buildSpans();
+        images.push_back(image);
     }
 
     return Spritesheet(images);
@@ -12,14 +12,16 @@
 #include "vbase.hh"
 #include "abase.hh"
 #include "ibase.hh"
+#include "upscale.hh"
 
 class GameBackend
 {
 public:
-    GameBackend(int sampleRate) : _scale(1)
+    GameBackend(int sampleRate) : _scale(1), _filter(UpscaleFilter::None)
     {
-        vbase_init();
+        vbase_init(_upscaler);
         vbase_set_scale(_scale);
+        vbase_set_filter(_filter);
         abase_init(sampleRate);
         ibase_init();
     }
@@ -38,17 +40,25 @@ public:
         return ret;
     }
 
-    void blit() const
+    void flip() const { vbase_flip(); }
+    void repeat() const { vbase_repeat(); }
+    void sync() const { vbase_sync(); }
+    double lateness() const { return vbase_lateness(); }
+    bool nextRefresh(double &blend, bool wait) const
     {
-        vbase_flip();
-        vbase_sync();
+        return vbase_next_refresh(blend, wait);
     }
 
     int scale() const { return _scale; }
     void scale(int s) { vbase_set_scale(_scale = s); }
+    UpscaleFilter filter() const { return _filter; }
+    void filter(UpscaleFilter f) { vbase_set_filter(_filter = f); }
 
 private:
+    // destroyed only after vbase_quit has stopped using it
+    Upscaler _upscaler;
     int _scale;
+    UpscaleFilter _filter;
 };
 
 #endif // M_BACKEND_HH
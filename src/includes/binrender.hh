@@ -0,0 +1,141 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// binrender.hh: includes for binrender.cc; tile-binned deferred rendering
+
+#ifndef M_BINRENDER_HH
+#define M_BINRENDER_HH
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "defs.hh"
+#include "image.hh"
+
+enum class DrawOp
+{
+    Blit,
+    BlitTiled,
+    BlitFast,
+    BlitAdditive,
+    BlitAdditiveTiled,
+    BlitModulated,
+    BlitFastModulated,
+    BlitAdditiveModulated,
+    BlitRaster,
+    BlitRasterTiled,
+    Add,
+    Subtract,
+    Clear,
+    // draws a BinnedRenderer whose drawing was deferred into this list
+    Pass
+};
+
+class BinnedRenderer;
+
+// one recorded drawing operation on the target image
+struct DrawCommand
+{
+    DrawOp op;
+    Image *src;
+    // keeps src alive until the frame has been drawn
+    std::shared_ptr<Image> keep;
+    int dx, dy, sx, sy, sw, sh;
+    // the color of color operations, or the shade of modulated blits
+    Color color;
+    // raster blits use sh lines starting from this index; passes use
+    // this recorded list
+    std::size_t line;
+    BinnedRenderer *pass;
+};
+
+class DrawList
+{
+public:
+    void clear();
+    bool empty() const { return _commands.empty(); }
+    // if set, sources are recorded as snapshots, so that they may be
+    // drawn to before the list is drawn
+    void setSnapshots(bool snapshots) { _snapshots = snapshots; }
+    bool snapshots() const { return _snapshots; }
+    void add(DrawOp op, Image *src, int dx, int dy,
+                int sx, int sy, int sw, int sh, Color shade = Color());
+    void addRaster(DrawOp op, Image *src, int dx, int dy, int sw,
+                const RasterLine *lines, int count);
+    void addColor(DrawOp op, Color color, int x, int y, int w, int h);
+    // the pass draws list into target only when this list is drawn
+    void addPass(BinnedRenderer &pass, Image &target, DrawList &&list);
+    // draws every command into dst
+    void draw(Image &dst) const;
+    // draws a command into dst, whose top left corner is at (ox, oy)
+    // of the image the command was recorded on
+    void draw(Image &dst, const DrawCommand &cmd, int ox, int oy) const;
+    const std::vector<DrawCommand> &commands() const { return _commands; }
+    const RasterLine *lines(const DrawCommand &cmd) const
+    {
+        return _lines.data() + cmd.line;
+    }
+private:
+    std::shared_ptr<Image> source(Image *src);
+
+    std::vector<DrawCommand> _commands;
+    std::vector<RasterLine> _lines;
+    std::vector<DrawList> _passes;
+    // images drawn by passes in this list; never snapshotted
+    std::vector<const Image *> _produced;
+    bool _snapshots{false};
+};
+
+// records everything drawn into an image during a frame, then draws it one
+// screen tile at a time, so that each tile stays in cache through all of
+// the layers. the tiles are shared between a small pool of threads.
+class BinnedRenderer
+{
+public:
+    constexpr static int TileWidth = 64;
+    constexpr static int TileHeight = 52;
+
+    BinnedRenderer(Image &target);
+    ~BinnedRenderer();
+    // from now on, blits into the target are recorded; fb is the image
+    // the target will be drawn on
+    void begin(const Image &fb);
+    // draws everything recorded since begin(), or if fb is being
+    // recorded, defers that until fb is drawn
+    void end(Image &fb);
+    // draws a list recorded on the target
+    void draw(const DrawList &list);
+private:
+    void bin();
+    void drawTiles(Image &tile);
+    void drawTile(Image &tile, int index);
+    void workerLoop();
+
+    Image &_target;
+    int _columns;
+    int _rows;
+    DrawList _list;
+    // the list being drawn
+    const DrawList *_drawing;
+    // indexes into the command list for each tile
+    std::vector<std::vector<int>> _bins;
+    Color *_pixels;
+    Image _tile;
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    unsigned long _generation;
+    int _busy;
+    bool _quit;
+    std::atomic<int> _nextTile;
+};
+
+#endif // M_BINRENDER_HH
@@ -0,0 +1,64 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// blit.hh: includes for blit.cc; per-row pixel kernels for image blits
+
+#ifndef M_BLIT_HH
+#define M_BLIT_HH
+
+#include "defs.hh"
+#include "color.hh"
+
+// combines n pixels of src into dst
+using BlitRowKernel = void (*)(Color *dst, const Color *src, int n);
+// applies a color to n pixels of dst
+using ColorRowKernel = void (*)(Color *dst, int n, Color color);
+// applies a color to n pixels of src, writing them to dst
+using ColorCopyKernel = void (*)(Color *dst, const Color *src, int n,
+                                Color color);
+
+// dst = src, skipping transparent source pixels
+extern BlitRowKernel BlitRowTransparent;
+// dst = dst + src
+extern BlitRowKernel BlitRowAdditive;
+// dst += src, which unlike the above keeps the top four bits of dst
+extern BlitRowKernel BlitRowAdditiveKeep;
+// dst = dst + color
+extern ColorRowKernel ColorRowAdd;
+// dst = dst - color
+extern ColorRowKernel ColorRowSubtract;
+// as above, but transparent pixels are left alone
+extern ColorRowKernel ColorRowAddSolid;
+extern ColorRowKernel ColorRowSubtractSolid;
+// dst = src - color
+extern ColorCopyKernel ColorRowCopySubtract;
+// as above, but transparent source pixels are skipped
+extern ColorCopyKernel BlitRowModulated;
+// dst = dst + (src - color)
+extern ColorCopyKernel BlitRowAdditiveModulated;
+// halves the channels of each dst pixel that are set in the src pixel
+extern BlitRowKernel BlitRowHalve;
+
+// kernels for scaling frames up. each source row comes with the rows
+// above and below it, and all three have a pixel to spare on both ends.
+// scale2x writes 2n pixels into each of out[0] and out[1]
+using Scale2xRowKernel = void (*)(Color *const *out, const Color *above,
+                                const Color *row, const Color *below, int n);
+// scale3x writes 3n pixels into each of out[0] to out[2]
+using Scale3xRowKernel = Scale2xRowKernel;
+// dst = each of the n pixels of src repeated factor times
+using ExpandRowKernel = void (*)(Color *dst, const Color *src, int n,
+                                int factor);
+
+extern Scale2xRowKernel Scale2xRow;
+extern Scale3xRowKernel Scale3xRow;
+extern ExpandRowKernel ExpandRow;
+
+// picks the fastest kernels supported by this CPU; call once on startup
+void InitBlitKernels();
+const char *GetBlitKernelName();
+
+#endif // M_BLIT_HH
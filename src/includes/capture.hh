@@ -0,0 +1,32 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// capture.hh: includes for capture.cc; recording the shown frames to a file
+
+#ifndef M_CAPTURE_HH
+#define M_CAPTURE_HH
+
+#include <string>
+#include "defs.hh"
+
+// frames are recorded into this file if not empty; set from the config.
+// tools/capture_to_y4m.py converts the file into a video
+extern std::string captureFile;
+
+// one frame is captured per tick: the first one shown during it, or the
+// last one shown before it if it had none. capturing only ever copies the
+// frame into a queue; it is compressed and written by a thread of its own,
+// and the frame is dropped if that thread has fallen too far behind
+void StartCapture();
+// call whenever a frame is shown; changed is false if it is the same as
+// the one shown before it. fb_back must not be drawn on during the call
+void CaptureFrame(bool changed);
+// call for a tick that showed no frame
+void CaptureSkippedFrame();
+// writes out the queued frames, then logs how many were dropped
+void StopCapture();
+
+#endif // M_CAPTURE_HH
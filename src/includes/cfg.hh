@@ -19,6 +19,7 @@ public:
     ConfigFile() : keys() {}
     ConfigFile(std::istream &stream);
     void write(std::ostream &stream);
+    bool has(const std::string &key) const;
     bool get(const std::string &key, bool fallback);
     int get(const std::string &key, int fallback);
     double get(const std::string &key, double fallback);
@@ -15,10 +15,35 @@
 #include "defs.hh"
 #include "maths.hh"
 
+// saturating per-channel add and subtract on packed 0x8RGB values.
+// T is std::uint16_t or a GCC vector of them, one color per 16-bit lane;
+// the result always has the 0x8000 bit set, like Color(r, g, b)
+template <class T>
+constexpr REALLY_INLINE T ColorAddPacked(T a, T b)
+{
+    // add the low three bits of each channel, then fix up the top bit
+    T t = (a & 0x0777) + (b & 0x0777);
+    T s = t ^ ((a ^ b) & 0x0888);
+    // channels that carried out saturate to 15
+    T c = ((a & b) | ((a | b) & t)) & 0x0888;
+    return ((s | ((c << 1) - (c >> 3))) & 0x0FFF) | 0x8000;
+}
+
+template <class T>
+constexpr REALLY_INLINE T ColorSubtractPacked(T a, T b)
+{
+    // the top bit of each channel is set so that borrows cannot cross
+    T d = (a | 0x0888) - (b & 0x0777);
+    T s = d ^ ((a ^ ~b) & 0x0888);
+    // channels that borrowed out saturate to 0
+    T c = ((~a & b) | (~(a ^ b) & ~d)) & 0x0888;
+    return ((s & ~((c << 1) - (c >> 3))) & 0x0FFF) | 0x8000;
+}
+
 struct Color
 {
-    Color() : Color(0) {}
-    Color(std::uint16_t v_) : v(v_) { }
+    constexpr Color() : Color(0) {}
+    constexpr Color(std::uint16_t v_) : v(v_) { }
     Color(int r, int g, int b) 
         : v((clamp(r, 0, S_MAXCLR) << 8) 
           | (clamp(g, 0, S_MAXCLR) << 4) 
@@ -43,4 +68,28 @@ struct Color
     std::uint16_t v;
 };
 
+inline Color operator+(const Color &lhs, const Color &rhs)
+{
+    return Color(ColorAddPacked<std::uint16_t>(lhs.v, rhs.v));
+}
+
+inline Color operator-(const Color &lhs, const Color &rhs)
+{
+    return Color(ColorSubtractPacked<std::uint16_t>(lhs.v, rhs.v));
+}
+
+// unlike + and -, these keep the top four bits of the left-hand side
+inline Color& Color::operator+=(const Color &rhs)
+{
+    v = (v & 0xF000) | (ColorAddPacked<std::uint16_t>(v, rhs.v) & 0x0FFF);
+    return *this;
+}
+
+inline Color& Color::operator-=(const Color &rhs)
+{
+    v = (v & 0xF000)
+        | (ColorSubtractPacked<std::uint16_t>(v, rhs.v) & 0x0FFF);
+    return *this;
+}
+
 #endif // M_COLOR_HH
@@ -0,0 +1,81 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// compositor.hh: includes for compositor.cc; drawing stage layers
+
+#ifndef M_COMPOSITOR_HH
+#define M_COMPOSITOR_HH
+
+#include <vector>
+#include <memory>
+#include "defs.hh"
+#include "image.hh"
+#include "layer.hh"
+
+// where a layer is in one frame: it draws screen rows y0 to y1 - 1 from
+// consecutive image rows starting at sy, which wrap around if wrap is set,
+// with image column sx at the left edge. opaque is set if an opaque image
+// row covers its screen row from edge to edge
+struct LayerPlacement
+{
+    LayerScroll scroll;
+    int sx;
+    int y0;
+    int y1;
+    int sy;
+    bool wrap;
+    bool opaque;
+};
+
+// draws a list of layers from the bottom up. when built, the list is
+// turned into a program of one step per layer, which calls the code made
+// for the descriptor of the layer; each layer is placed only once a frame
+class LayerCompositor
+{
+public:
+    using PlaceFunction = void (*)(const BackgroundLayer &layer,
+                                   LayerScroll scroll, LayerPlacement &place);
+    // draws screen rows y0 to y1 - 1 of the layer, as far as it reaches
+    using DrawFunction = void (*)(const BackgroundLayer &layer, Image &fb,
+                                  const LayerPlacement &place, int y0, int y1);
+
+    // the layers are profiled under name. if culled is set, rows covered
+    // by an opaque layer above are left out of the layers below, as are
+    // rows that a layer would not draw on anyway. the layers must outlive
+    // the compositor, and must not be added or removed after this
+    void build(const std::vector<BackgroundLayer *> &layers,
+               const char *name, bool culled);
+    template <class T>
+    void build(const std::vector<std::unique_ptr<T>> &layers,
+               const char *name, bool culled)
+    {
+        std::vector<BackgroundLayer *> list;
+        for (const auto &layer : layers)
+            list.push_back(layer.get());
+        build(list, name, culled);
+    }
+    void draw(Image &fb, LayerScroll scroll);
+private:
+    struct Step
+    {
+        BackgroundLayer *layer;
+        PlaceFunction place;
+        DrawFunction draw;
+    };
+    // which rows of the screen the layer leaves alone (transparent), draws
+    // on (mixed) or covers completely (opaque)
+    static void classifyRows(const BackgroundLayer &layer,
+                             const LayerPlacement &place, LayerRows &rows);
+
+    std::vector<Step> _program;
+    // for the frame being drawn, by step
+    std::vector<LayerPlacement> _placements;
+    std::vector<LayerRows> _rows;
+    const char *_name{""};
+    bool _culled{false};
+};
+
+#endif // M_COMPOSITOR_HH
@@ -24,5 +24,9 @@ extern PlaybackMode pmode;
 extern int startContinues;
 extern bool musicEnabled;
 extern bool sfxEnabled;
+extern bool pipelinedRendering;
+extern bool interpolateFrames;
+// at most this many frames in a row are skipped when running late
+extern int maxFrameSkip;
 
 #endif // M_CONFIG_HH
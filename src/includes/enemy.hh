@@ -18,6 +18,8 @@
 #include "fixrng.hh"
 
 int ScaleFireTicks(Shooter &stg, int value);
+// drops the tinted frames of flashing enemies; call when unloading sprites
+void ClearEnemyFlashCache();
 
 class EnemySprite : public Sprite
 {
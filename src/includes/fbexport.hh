@@ -0,0 +1,36 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// fbexport.hh: includes for fbexport.cc; the shown frames in shared memory
+
+#ifndef M_FBEXPORT_HH
+#define M_FBEXPORT_HH
+
+#include <string>
+#include "defs.hh"
+
+// if not empty, the name of a POSIX shared memory object into which every
+// shown frame is published; set from the config. the object is laid out as
+//     0: the eight characters "MPXSHFB1"
+//     8: width and height, 16-bit integers
+//    12: sequence number, 32-bit integer; odd while a frame is written
+//    16: number of frames shown since the export started, 64-bit integer
+//    24: time the frame was shown, in microseconds of the monotonic clock,
+//        64-bit integer
+//    64: the frame as shown, width * height colors as in Color
+// all in native byte order. a reader reads the sequence number, then what
+// it needs of the frame, and then the sequence number again; if it was odd
+// or has changed, the frame was being written and must be read again.
+// tools/shm_reader.py reads frames from it
+extern std::string sharedFramebuffer;
+
+void StartFramebufferExport();
+// call whenever a frame is shown; changed is false if it is the same as
+// the one shown before it. fb_back must not be drawn on during the call
+void ExportFrame(bool changed);
+void StopFramebufferExport();
+
+#endif // M_FBEXPORT_HH
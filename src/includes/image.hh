@@ -10,6 +10,7 @@
 #define M_IMAGE_HH
 
 #include <vector>
+#include <memory>
 #include <cstdint>
 #include <array>
 #include "defs.hh"
@@ -18,11 +19,40 @@
 
 constexpr int S_STRIDE = S_WIDTH;
 
-class Image
+// run of opaque pixels within an image row
+struct ImageSpan
+{
+    std::uint16_t offset;
+    std::uint16_t length;
+};
+
+class DrawList;
+class OverdrawMap;
+
+// how much of an image row is opaque
+enum class RowOpacity : std::uint8_t
+{
+    Transparent,
+    Mixed,
+    Opaque
+};
+
+// source position of one destination row in a raster blit
+struct RasterLine
+{
+    int sx;
+    int sy;
+};
+
+class Image : public std::enable_shared_from_this<Image>
 {
 public:
     Image(int width, int height);
     Image(int width, int height, std::vector<Color> &&data);
+    // a view of a rectangle in a pixel buffer shared with other images,
+    // rows stride pixels apart; writing to the view detaches it first
+    Image(std::shared_ptr<const std::vector<Color>> atlas,
+            std::size_t offset, int width, int height, int stride);
     void blit(Image &dst, int dx, int dy, int sx, int sy, int sw, int sh);
     void blitTiled(Image &dst, int dx, int dy, int sx, int sy, int sw, int sh);
     // ignores transparency on this (source) image
@@ -31,7 +61,24 @@ public:
                         int sx, int sy, int sw, int sh);
     void blitAdditiveTiled(Image &dst, int dx, int dy,
                         int sx, int sy, int sw, int sh);
+    // as blit, blitFast and blitAdditive, but every source pixel is
+    // darkened by shade on the way, in the same pass
+    void blitModulated(Image &dst, int dx, int dy,
+                        int sx, int sy, int sw, int sh, Color shade);
+    void blitFastModulated(Image &dst, int dx, int dy,
+                        int sx, int sy, int sw, int sh, Color shade);
+    void blitAdditiveModulated(Image &dst, int dx, int dy,
+                        int sx, int sy, int sw, int sh, Color shade);
+    // blits count rows of width sw to dst starting at (dx, dy), taking
+    // each row i from (lines[i].sx, lines[i].sy); rows whose source
+    // row is outside this image are skipped
+    void blitRaster(Image &dst, int dx, int dy, int sw,
+                        const RasterLine *lines, int count);
+    // as above, but the source wraps around in both directions
+    void blitRasterTiled(Image &dst, int dx, int dy, int sw,
+                        const RasterLine *lines, int count);
     void clear();
+    void clear(int x, int y, int w, int h);
     void fill(Color color);
     bool overlaps(Image &other, int x, int y, int ox, int oy,
                         int w, int h) const;
@@ -39,13 +86,39 @@ public:
                         int w, int h) const;
     int width() const { return _width; }
     int height() const { return _height; }
-    std::vector<Color> &buffer() { return _data; }
+    // distance between rows in pixels
+    int stride() const { return _stride; }
+    const Color *pixels() const
+    {
+        return (_atlas ? _atlas->data() : _data.data()) + _offset;
+    }
+    // the caller may write pixels, so this drops the span table
+    std::vector<Color> &buffer() { detach(); dropSpans(); return _data; }
+    // builds a table of opaque runs per row; blit will then skip
+    // transparent pixels entirely
+    void buildSpans();
+    void dropSpans() { _spanRows.clear(); _spans.clear(); }
+    bool hasSpans() const { return !_spanRows.empty(); }
+    // classifies every row by how many of its pixels are opaque
+    std::vector<RowOpacity> rowOpacity() const;
     void add(Color color);
     void subtract(Color color);
     void addSolid(Color color);
     void subtractSolid(Color color);
     void addSolid(Color color, int x, int y, int w, int h);
     void subtractSolid(Color color, int x, int y, int w, int h);
+    void add(Color color, int x, int y, int w, int h);
+    void subtract(Color color, int x, int y, int w, int h);
+    // while set, blits into this image, clear() and add/subtract are
+    // only recorded into the list
+    void setRecorder(DrawList *list) { _recorder = list; }
+    DrawList *recorder() const { return _recorder; }
+    // while set, every pixel written to this image is counted in the map
+    void setOverdraw(OverdrawMap *map) { _overdraw = map; }
+    OverdrawMap *overdraw() const { return _overdraw; }
+    // an image with the current pixels of this one that will not change
+    // when this one is drawn to; both share the pixels until then
+    std::shared_ptr<Image> snapshot();
     
     inline void blit(Image &fb)
     {
@@ -56,9 +129,23 @@ public:
         blit(fb, x, y, 0, 0, _width, _height);
     }
 private:
+    // copies the pixels of a view into an image of its own
+    void detach();
+
     int _width;
     int _height;
+    // unused if this is a view
     std::vector<Color> _data;
+    std::shared_ptr<const std::vector<Color>> _atlas;
+    std::size_t _offset;
+    int _stride;
+    // spans of row y are _spans[_spanRows[y]] to _spans[_spanRows[y + 1]]
+    std::vector<int> _spanRows;
+    std::vector<ImageSpan> _spans;
+    DrawList *_recorder = nullptr;
+    OverdrawMap *_overdraw = nullptr;
+    // kept until the pixels change, so that each is only made once
+    std::shared_ptr<Image> _snapshot;
 };
 
 #endif // M_IMAGE_HH
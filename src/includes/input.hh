@@ -46,6 +46,11 @@ struct MenuInputState
     bool select;
     bool exit;
 
+    bool any() const
+    {
+        return up || down || left || right || select || exit;
+    }
+
     bool &value(MenuInput inp)
     {
         switch (inp)
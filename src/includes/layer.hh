@@ -10,6 +10,9 @@
 #define M_LAYER_HH
 
 #include <vector>
+#include <array>
+#include <cstdint>
+#include <algorithm>
 #include <istream>
 #include <memory>
 #include "defs.hh"
@@ -44,6 +47,7 @@ public:
     FadeWindow(int x, int y, int w, int h);
     void blit(Image &fb);
     bool hasColor() const;
+    Color color() const { return _color; }
     bool fadeIn(int n = 1);
     bool fadeOut(int n = 1);
 private:
@@ -62,17 +66,99 @@ struct LayerScroll
     Fix y;
 };
 
-// background layer
+// for each row of the screen, how much of it a layer draws on
+using LayerRows = std::array<RowOpacity, S_HEIGHT>;
+
+class TileStrip;
+
+// how a layer is placed on the screen, and whether it repeats
+enum class LayerTiling : std::uint8_t
+{
+    // repeats in both directions
+    Both,
+    // drawn once; nothing is drawn outside the image
+    None,
+    // repeats horizontally. the top of the image is placed at the vertical
+    // offset less the scroll, and the layer reaches no further down than
+    // the height of the image
+    Horizontal,
+    // as above, but the image wraps around vertically when its top is
+    // above the screen
+    HorizontalWrapped
+};
+
+// how the pixels of a layer are combined with those below it
+enum class LayerBlend : std::uint8_t
+{
+    // opaque pixels replace those below
+    Normal,
+    // pixels are added to those below
+    Additive
+};
+
+// how the rows of a layer move relative to each other
+enum class LayerRowEffect : std::uint8_t
+{
+    None,
+    // each image row scrolls horizontally a little faster than the one
+    // above it, or slower if reversed
+    Parallax,
+    // rows are shifted along a sine wave that moves on every tick
+    Wave
+};
+
+// what kind of layer a layer is; see LayerCompositor
+struct LayerDescriptor
+{
+    LayerTiling tiling{LayerTiling::Both};
+    LayerBlend blend{LayerBlend::Normal};
+    LayerRowEffect rowEffect{LayerRowEffect::None};
+    bool reverse{false};
+    // the layer scrolls by these multiples of the scroll of the view, and
+    // its image is moved right and down by the offsets
+    Fix scrollXMul;
+    Fix scrollYMul;
+    int offsetX{0};
+    int offsetY{0};
+};
+
+// stage layer; drawn by a LayerCompositor as its descriptor says
 class BackgroundLayer
 {
 public:
-    BackgroundLayer(std::shared_ptr<Image> bg,
-                    int ox, int oy, Fix sxm, Fix sym);
-    virtual void blit(Image &fb, LayerScroll scroll);
-    void blitIfShown(Image &fb, LayerScroll scroll)
+    BackgroundLayer(std::shared_ptr<Image> bg, const LayerDescriptor &desc);
+    // the image of a tilemap layer is drawn as it scrolls
+    BackgroundLayer(std::shared_ptr<TileStrip> strip,
+                    const LayerDescriptor &desc);
+    const LayerDescriptor &descriptor() const
+    {
+        return _desc;
+    }
+    Image &image() const
+    {
+        return *_img;
+    }
+    TileStrip *strip() const
+    {
+        return _strip.get();
+    }
+    // how much of each image row is opaque, or empty if not known
+    const std::vector<RowOpacity> &rowOpacity() const
+    {
+        return _rowOpacity;
+    }
+    int phase() const
+    {
+        return _phase;
+    }
+    // moves animations on; called once per frame, after all rows are drawn
+    void advance();
+    // classifies the rows of the image. until then, the layer is assumed
+    // to draw on every row it reaches and to cover none of them
+    void analyzeOpacity();
+    bool shown() const
     {
-        if (!_hidden)
-            blit(fb, scroll);
+        return !_hidden;
     }
     void show()
     {
@@ -83,98 +169,21 @@ public:
         _hidden = true;
     }
 protected:
+    LayerDescriptor _desc;
     bool _hidden{false};
     std::shared_ptr<Image> _img;
-    int _offsetX;
-    int _offsetY;
-    Fix _scrollXMul;
-    Fix _scrollYMul;
+    std::shared_ptr<TileStrip> _strip;
+    std::vector<RowOpacity> _rowOpacity;
+    int _phase{0};
 };
 
-// foreground layer
-class ForegroundLayer
+// stage layer that sprites collide with
+class ForegroundLayer : public BackgroundLayer
 {
 public:
-    ForegroundLayer(std::shared_ptr<Image> bg,
-                    int ox, int oy, Fix sxm, Fix sym);
-    virtual void blit(Image &fb, LayerScroll scroll);
-    virtual bool hitsSprite(Image &spriteImage, LayerScroll scroll,
+    using BackgroundLayer::BackgroundLayer;
+    bool hitsSprite(Image &spriteImage, LayerScroll scroll,
                 const Hitbox &box, Fix spriteX, Fix spriteY) const;
-protected:
-    std::shared_ptr<Image> _img;
-    int _offsetX;
-    int _offsetY;
-    Fix _scrollXMul;
-    Fix _scrollYMul;
-};
-
-class NonTiledBackgroundLayer : public BackgroundLayer
-{
-public:
-    NonTiledBackgroundLayer(std::shared_ptr<Image> bg,
-                    int ox, int oy, Fix sxm, Fix sym)
-        : BackgroundLayer(bg, ox, oy, sxm, sym) {}
-    void blit(Image &fb, LayerScroll scroll) override;
-};
-
-class HTiledBackgroundLayer : public BackgroundLayer
-{
-public:
-    HTiledBackgroundLayer(std::shared_ptr<Image> bg,
-                    int ox, int oy, Fix sxm, Fix sym)
-        : BackgroundLayer(bg, ox, oy, sxm, sym) {}
-    void blit(Image &fb, LayerScroll scroll) override;
-};
-
-class AdditiveBackgroundLayer : public BackgroundLayer
-{
-public:
-    AdditiveBackgroundLayer(std::shared_ptr<Image> bg,
-                    int ox, int oy, Fix sxm, Fix sym)
-        : BackgroundLayer(bg, ox, oy, sxm, sym) {}
-    void blit(Image &fb, LayerScroll scroll) override;
-};
-
-class HTiledAdditiveBackgroundLayer : public BackgroundLayer
-{
-public:
-    HTiledAdditiveBackgroundLayer(std::shared_ptr<Image> bg,
-                    int ox, int oy, Fix sxm, Fix sym)
-        : BackgroundLayer(bg, ox, oy, sxm, sym) {}
-    void blit(Image &fb, LayerScroll scroll) override;
-};
-
-class HTiledParallaxBackgroundLayer : public BackgroundLayer
-{
-public:
-    HTiledParallaxBackgroundLayer(std::shared_ptr<Image> bg,
-                    int ox, int oy, Fix sxm, Fix sym, int meta)
-        : BackgroundLayer(bg, ox, oy, sxm, sym), sign(meta ? -1 : 1) {}
-    void blit(Image &fb, LayerScroll scroll) override;
-private:
-    int sign;
-};
-
-class HTiledWavyBackgroundLayer : public BackgroundLayer
-{
-public:
-    HTiledWavyBackgroundLayer(std::shared_ptr<Image> bg,
-                    int ox, int oy, Fix sxm, Fix sym, int meta)
-        : BackgroundLayer(bg, ox, oy, sxm, sym) {}
-    void blit(Image &fb, LayerScroll scroll) override;
-private:
-    int phase{0};
-};
-
-class NonTiledForegroundLayer : public ForegroundLayer
-{
-public:
-    NonTiledForegroundLayer(std::shared_ptr<Image> bg,
-                    int ox, int oy, Fix sxm, Fix sym)
-        : ForegroundLayer(bg, ox, oy, sxm, sym) {}
-    void blit(Image &fb, LayerScroll scroll) override;
-    virtual bool hitsSprite(Image &spriteImage, LayerScroll scroll,
-                const Hitbox &box, Fix spriteX, Fix spriteY) const override;
 };
 
 // text layer; consists of non-overlapping sprites
@@ -185,29 +194,38 @@ public:
     constexpr static int Columns = (S_WIDTH + FontWidth - 1) / FontWidth;
     constexpr static int Rows = (S_HEIGHT + FontHeight - 1) / FontHeight;
     TextLayer() : _img(std::make_unique<Image>(S_WIDTH, S_HEIGHT)),
-            _textBuf() { 
+            _textBuf(), _rowUsed(), _changed(false) { 
         clear();
     }
+    // only the rows that have been written to are composited
     void blit(Image &fb) const
     {
-        _img->blit(fb, 0, 0, 0, 0, S_WIDTH, S_HEIGHT);
+        forEachUsedBand([&](int y, int h) {
+            _img->blit(fb, 0, y, 0, y, S_WIDTH, h);
+        });
     }
     void clear()
     {
-        _img->clear();
+        std::vector<Color> &buf = _img->buffer();
+        forEachUsedBand([&](int y, int h) {
+            std::fill(buf.begin() + y * S_WIDTH,
+                      buf.begin() + (y + h) * S_WIDTH, Color::transparent);
+        });
+        _textBuf.fill(TextCell());
+        _rowUsed.fill(false);
+        _changed = true;
     }
     void writeChar(const Spritesheet &font, int x, int y, char c)
     {
-        font.blitFast(*_img.get(), c, x * FontWidth, y * FontHeight);
+        writeCell<false>(font, x, y, c);
     }
     void writeString
         (const Spritesheet &font, int x, int y, const std::string &s)
     {
-        Image &fb = *_img.get();
         int tx = x * FontWidth;
         for (const char &c : s)
         {
-            font.blitFast(fb, c, tx, y * FontHeight);
+            writeCell<false>(font, x++, y, c);
             if (tx > S_WIDTH)
                 break;
             tx += FontWidth;
@@ -216,11 +234,10 @@ public:
     void writeStringTransp
         (const Spritesheet &font, int x, int y, const std::string &s)
     {
-        Image &fb = *_img.get();
         int tx = x * FontWidth;
         for (const char &c : s)
         {
-            font.blit(fb, c, tx, y * FontHeight);
+            writeCell<true>(font, x++, y, c);
             if (tx > S_WIDTH)
                 break;
             tx += FontWidth;
@@ -231,10 +248,88 @@ public:
     {
         writeString(font, x - s.length() + 1, y, s);
     }
+    // true if the layer was cleared or written to since the last call
+    bool takeChanges()
+    {
+        bool changed = _changed;
+        _changed = false;
+        return changed;
+    }
 
 private:
+    // the glyph known to fill a cell exactly, or no font if unknown
+    struct TextCell
+    {
+        const Spritesheet *font;
+        char c;
+    };
+
+    template <bool transparent>
+    void writeCell(const Spritesheet &font, int x, int y, char c)
+    {
+        auto glyph = font.getImage(c);
+        int tx = x * FontWidth, ty = y * FontHeight;
+        int w = glyph->width(), h = glyph->height();
+        // only opaque glyphs of exactly one cell are remembered, so that
+        // no other write can change the cell without clearing its entry
+        bool exact = !transparent && w == FontWidth && h == FontHeight
+                && x >= 0 && x < Columns && y >= 0 && y < Rows;
+        if (exact)
+        {
+            const TextCell &cell = _textBuf[y * Columns + x];
+            if (cell.font == &font && cell.c == c)
+                return;
+        }
+
+        if constexpr (transparent)
+            font.blit(*_img, c, tx, ty);
+        else
+            font.blitFast(*_img, c, tx, ty);
+        forgetCells(tx, ty, w, h);
+        if (exact)
+            _textBuf[y * Columns + x] = { &font, c };
+        _changed = true;
+    }
+
+    // clears the entries of all cells in the given rectangle and marks
+    // its rows as used
+    void forgetCells(int tx, int ty, int w, int h)
+    {
+        int x0 = std::max(tx, 0) / FontWidth;
+        int y0 = std::max(ty, 0) / FontHeight;
+        int x1 = std::min(tx + w, S_WIDTH) - 1;
+        int y1 = std::min(ty + h, S_HEIGHT) - 1;
+        if (x1 < 0 || y1 < 0) return;
+        x1 /= FontWidth, y1 /= FontHeight;
+        for (int cy = y0; cy <= y1; ++cy)
+        {
+            _rowUsed[cy] = true;
+            for (int cx = x0; cx <= x1; ++cx)
+                _textBuf[cy * Columns + cx] = TextCell();
+        }
+    }
+
+    // calls f(y, h) for each run of used rows, in pixels
+    template <class F>
+    void forEachUsedBand(F f) const
+    {
+        int r = 0, r0;
+        while (r < Rows)
+        {
+            if (!_rowUsed[r++])
+                continue;
+            r0 = r - 1;
+            while (r < Rows && _rowUsed[r])
+                ++r;
+            f(r0 * FontHeight,
+              std::min(r * FontHeight, S_HEIGHT) - r0 * FontHeight);
+        }
+    }
+
     std::unique_ptr<Image> _img;
-    std::array<char, Rows * Columns> _textBuf;
+    std::array<TextCell, Rows * Columns> _textBuf;
+    std::array<bool, Rows> _rowUsed;
+    bool _changed;
 };
 
 #endif // M_LAYER_HH
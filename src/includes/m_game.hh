@@ -15,6 +15,7 @@
 #include <string>
 #include "defs.hh"
 #include "image.hh"
+#include "binrender.hh"
 #include "sprite.hh"
 #include "layer.hh"
 #include "modes.hh"
@@ -49,9 +50,10 @@ struct ScreenPopup
     int ticks{0};
     bool permanent{false};
     Image back{S_WIDTH, 32};
-    Image front{S_WIDTH, 32};
 
     void blit(Image &fb);
+    void advance();
+    bool isStatic() const;
     void clear();
     void showString(std::string text);
     void showStage(int num);
@@ -82,9 +84,12 @@ struct Shooter
     int stageNum{0};
     ShooterAssets assets;
     LayerScroll scroll;
+    // the scroll at the start of the tick, for interpolated frames
+    LayerScroll prevScroll;
     Fix xSpeed;
     std::unique_ptr<ScreenPopup> popup;
     Image gameArea{S_WIDTH, S_GHEIGHT};
+    BinnedRenderer gameRenderer{gameArea};
     Image pauseBuffer{S_WIDTH, S_HEIGHT};
     bool paused{false};
     bool continueScreen{false};
@@ -103,6 +108,9 @@ struct Shooter
     PlaybackMode pmode;
 
     void blit(Image &fb);
+    void skipFrame();
+    bool isStatic() const;
+    bool takeChanges();
     void blitPlayer(Image &fb, int oy);
     void updateSprites(const int layer,
                         std::vector<std::shared_ptr<Sprite>> &sprites);
@@ -112,6 +120,7 @@ struct Shooter
     void controlTick();
     bool pauseTick();
     void tick();
+    void savePositions();
     void spawnPlayer(bool respawn);
     void respawnPlayer();
     void drawHUD();
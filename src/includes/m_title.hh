@@ -34,6 +34,8 @@ public:
 
     void draw(Image &fb);
     void tick();
+    bool isStatic() const;
+    bool takeChanges();
     void mainMenu(int cursorAt = 0);
     void highScores();
     void updateHighScores();
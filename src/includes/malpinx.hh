@@ -15,6 +15,10 @@
 
 extern std::unique_ptr<GameBackend> backend;
 extern int sampleRate;
+// frames drawn and skipped, and the longest run of skipped frames
+extern unsigned long framesDrawn, framesSkipped, longestFrameSkip;
+// frames shown again because nothing on the screen changed
+extern unsigned long framesUnchanged;
 
 void QuitGame();
 
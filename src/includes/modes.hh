@@ -33,11 +33,15 @@ void InitTitleScreen(bool instant);
 
 void DrawLogoFrame(Image &fb);
 void DrawTitleFrame(Image &fb);
+// true if the screen stays the same until something invalidates the frame
+bool IsTitleFrameStatic();
 
 void RunLogoFrame();
 void RunTitleFrame();
 
 void RenderGame(Image &fb);
+void SkipGameFrame();
+bool IsGameFrameStatic();
 void DoGameTick();
 
 #endif // M_MODES_HH
@@ -0,0 +1,57 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// overdraw.hh: includes for overdraw.cc; overdraw and layer cost profiling
+
+#ifndef M_OVERDRAW_HH
+#define M_OVERDRAW_HH
+
+#include <vector>
+#include <cstdint>
+#include "defs.hh"
+#include "color.hh"
+
+class Image;
+
+// counts how many times each pixel of an image is written to
+class OverdrawMap
+{
+public:
+    OverdrawMap(int width, int height);
+    void reset();
+    // counts n pixels written from (x, y) to the right; if src is given,
+    // only the pixels for which it is opaque are written
+    void countRow(int x, int y, const Color *src, int n);
+    // counts the part of the rectangle inside the map
+    void countRect(int x, int y, int w, int h);
+    // pixel writes counted since the last reset
+    unsigned long written() const { return _written; }
+    int width() const { return _width; }
+    int height() const { return _height; }
+    // replaces each pixel of dst with a color showing its count
+    void drawHeatMap(Image &dst) const;
+private:
+    int _width;
+    int _height;
+    std::vector<std::uint8_t> _counts;
+    unsigned long _written;
+};
+
+// while the game area is profiled, it is drawn without binning, so that
+// every layer is drawn in turn; from when a layer is started until the
+// next one is, its drawing time and pixel writes are measured.
+// set from the config; drawing the heat map implies profiling
+extern bool profileLayers;
+extern bool overdrawHeatMap;
+
+// returns true if the frame drawn into target is to be profiled
+bool ProfileBeginFrame(Image &target);
+// index tells apart layers of the same kind, if not negative
+void ProfileLayer(const char *name, int index = -1);
+// logs the frame and draws the heat map over target if enabled
+void ProfileEndFrame(Image &target);
+
+#endif // M_OVERDRAW_HH
@@ -12,17 +12,46 @@
 #include <array>
 #include "defs.hh"
 #include "image.hh"
+#include "fix.hh"
 
+// the finished frame; vbase_flip presents it as is, applying the fade
 extern Image fb_back;
-extern Image fb_front;
 extern bool isFading;
+// where the frame being drawn falls between the previous tick (0) and the
+// latest one (1); only below 1 when frames are interpolated
+extern Fix renderBlend;
+// set while drawing extra frames between two ticks, which must not move
+// any animation forward
+extern bool renderBetweenTicks;
+
+inline Fix Interpolate(Fix previous, Fix latest)
+{
+    return previous + (latest - previous) * renderBlend;
+}
 
 void FadeReset();
 void FadeResetToBlack();
 bool FadeStepOut();
 bool FadeStepIn();
+// global fade level of the frame in fb_back, from 0 (none) to S_MAXCLR
+int GetFadeLevel();
 void ClearScreen();
 void UpdateBackbuffer();
-void DrawFrame();
+// returns false if the frame would look exactly like the last one, in which
+// case nothing was drawn and it need not be flipped
+bool DrawFrame();
+// a static screen is only drawn again once this has been called
+void InvalidateFrame();
+// if the active mode allows it, moves its animations on by a frame without
+// drawing anything and returns true
+bool SkipFrame();
+
+// with a render thread, DrawFrame only records the frame, and the thread
+// draws it into fb_back while the next tick runs
+void StartRenderThread();
+void StopRenderThread();
+bool HasRenderThread();
+// waits until the frame being drawn, if any, is in fb_back
+void FinishFrame();
 
 #endif // M_RENDER_HH
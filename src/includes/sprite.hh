@@ -69,6 +69,12 @@ public:
     virtual void blit(Image &fb, int xoff, int yoff) const;
     Fix x() const { return _x; }
     Fix y() const { return _y; }
+    // the position to draw at, between the last two ticks if frames are
+    // interpolated
+    Fix drawX() const { return Interpolate(_prevX, _x); }
+    Fix drawY() const { return Interpolate(_prevY, _y); }
+    // remembers the position at the start of a tick
+    void savePosition() { _prevX = _x; _prevY = _y; }
     int width() const { return _width; }
     int height() const { return _height; }
     int flags() const { return _flags; }
@@ -122,6 +128,8 @@ protected:
     int _id;
     Fix _x;
     Fix _y;
+    Fix _prevX;
+    Fix _prevY;
     Hitbox _hitbox;
     int _width;
     int _height;
@@ -13,6 +13,7 @@
 #include <deque>
 #include "stage.hh"
 #include "layer.hh"
+#include "compositor.hh"
 #include "m_game.hh"
 #include "powerup.hh"
 
@@ -38,6 +39,9 @@ struct Stage
     std::vector<std::unique_ptr<BackgroundLayer>> backgroundLayers;
     std::vector<std::unique_ptr<ForegroundLayer>> terrainLayers;
     std::vector<std::unique_ptr<BackgroundLayer>> foregroundLayers;
+    LayerCompositor backgroundCompositor;
+    LayerCompositor terrainCompositor;
+    LayerCompositor foregroundCompositor;
     std::deque<ObjectSpawn> objectSpawns;
     std::deque<ObjectSpawn> delayedObjectSpawns;
     std::deque<ObjectSpawn>::iterator nextSpawn;
@@ -48,6 +52,13 @@ struct Stage
     void skipObjects(LayerScroll scroll);
     void hideLayer(int index);
     void showLayer(int index);
+    // called once all layers have been added
+    void buildCompositors();
+    void blitBackground(Image &fb, LayerScroll scroll);
+    void blitTerrain(Image &fb, LayerScroll scroll);
+    void blitForeground(Image &fb, LayerScroll scroll);
+    // moves the animations of the shown layers on as drawing them would
+    void advanceLayers();
 };
 
 #endif // M_STAGE_HH
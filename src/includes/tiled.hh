@@ -10,7 +10,10 @@
 #define M_TILED_HH
 
 #include <cstdint>
-#include "layer.hh"
+#include <vector>
+#include <memory>
+#include "image.hh"
+#include "sprite.hh"
 
 using Tile = std::uint16_t;
 constexpr int TILE_WIDTH = 16;
@@ -25,36 +28,24 @@ struct Tilemap
     const Tile &operator[](int index) const { return tiles[index]; }
 };
 
-// background layer made up of tiles
-class BackgroundTileLayer : public BackgroundLayer
+// the columns of a tilemap around the view, drawn into an image as the
+// view scrolls on; the image wraps around horizontally, so that it is drawn
+// from as a layer tiled in both directions
+class TileStrip
 {
 public:
-    BackgroundTileLayer(std::shared_ptr<Spritesheet> tiles,
-                        std::shared_ptr<Tilemap> map,
-                        int ox, int oy, Fix sxm, Fix sym);
-    void blit(Image &fb, LayerScroll scroll) override;
+    TileStrip(std::shared_ptr<Spritesheet> tiles,
+              std::shared_ptr<Tilemap> map);
+    std::shared_ptr<Image> image() const { return _img; }
+    // draws the columns that come into view at horizontal scroll x
+    void scrollTo(int x);
 private:
+    std::shared_ptr<Image> _img;
     std::shared_ptr<Spritesheet> _tiles;
     std::shared_ptr<Tilemap> _map;
-    int _leftmostColumn;
-    int _rightmostColumn;
-    int _scan;
-};
-
-// foreground layer made up of tiles
-class ForegroundTileLayer : public ForegroundLayer
-{
-public:
-    ForegroundTileLayer(std::shared_ptr<Spritesheet> tiles,
-                        std::shared_ptr<Tilemap> map,
-                        int ox, int oy, Fix sxm, Fix sym);
-    void blit(Image &fb, LayerScroll scroll) override;
-private:
-    std::shared_ptr<Spritesheet> _tiles;
-    std::shared_ptr<Tilemap> _map;
-    int _leftmostColumn;
-    int _rightmostColumn;
-    int _scan;
+    int _leftmostColumn{0};
+    int _rightmostColumn{-1};
+    int _scan{0};
 };
 
 #endif // M_TILED_HH
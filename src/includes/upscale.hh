@@ -0,0 +1,111 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// upscale.hh: includes for upscale.cc; software upscaling filters
+
+#ifndef M_UPSCALE_HH
+#define M_UPSCALE_HH
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "defs.hh"
+#include "color.hh"
+
+enum class UpscaleFilter
+{
+    // the video backend stretches the frame, repeating pixels
+    None,
+    // Scale2x and Scale3x; 4x is Scale2x done twice
+    Smooth,
+    // the last row of every pixel is dimmed
+    Scanlines,
+    // scanlines over a red, green and blue aperture grille
+    CRT
+};
+
+// frames are scaled up by at most this much; the video backend stretches
+// them the rest of the way
+constexpr int MAX_UPSCALE = 4;
+
+// unknown names are taken as None
+UpscaleFilter GetUpscaleFilter(const std::string &name);
+const char *GetUpscaleFilterName(UpscaleFilter filter);
+
+// scales frames up by a whole factor, splitting the rows into bands that
+// are shared between a small pool of threads
+class Upscaler
+{
+public:
+    Upscaler();
+    ~Upscaler();
+    void configure(UpscaleFilter filter, int factor);
+    // false if frames are to be shown as they are
+    bool active() const
+    {
+        return _filter != UpscaleFilter::None && _factor > 1;
+    }
+    UpscaleFilter filter() const { return _filter; }
+    int factor() const { return _factor; }
+    int width() const { return S_WIDTH * _factor; }
+    int height() const { return S_HEIGHT * _factor; }
+    // scales a frame of S_WIDTH by S_HEIGHT pixels into dst, whose rows
+    // are pitch bytes apart, darkening it by fade on the way
+    void scale(const Color *src, Color fade, void *dst, int pitch);
+private:
+    enum class Pass
+    {
+        Scale2x,
+        Scale3x,
+        Expand
+    };
+    // runs a pass over rows source rows, which are stride pixels apart and
+    // have a pixel to spare on every side
+    void run(Pass pass, const Color *src, int stride, int width, int rows,
+                void *dst, int pitch);
+    void drawBands();
+    void drawBand(int band);
+    void startWorkers();
+    void stopWorkers();
+    void workerLoop();
+    inline Color *outputRow(int y) const
+    {
+        return reinterpret_cast<Color *>(_dst + y * _pitch);
+    }
+
+    UpscaleFilter _filter;
+    int _factor;
+    // the frame, and for 4x the frame at 2x, with an edge of repeated
+    // pixels all around
+    std::vector<Color> _source;
+    std::vector<Color> _middle;
+    // channels to halve in each column of a grille row or a scanline
+    std::vector<Color> _grille;
+    std::vector<Color> _scanline;
+
+    // the pass being run
+    Pass _pass;
+    const Color *_src;
+    int _stride;
+    int _width;
+    int _rows;
+    unsigned char *_dst;
+    int _pitch;
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    unsigned long _generation;
+    int _busy;
+    bool _quit;
+    std::atomic<int> _nextBand;
+};
+
+#endif // M_UPSCALE_HH
@@ -9,12 +9,29 @@
 #ifndef M_VBASE_HH
 #define M_VBASE_HH
 
-void vbase_init();
+enum class UpscaleFilter;
+class Upscaler;
+
+// frames are scaled up with upscaler, which must outlive vbase_quit
+void vbase_init(Upscaler &upscaler);
 void vbase_set_scale(int scale);
+// frames are scaled up by the window scale in software with this filter
+void vbase_set_filter(UpscaleFilter filter);
 // should game stay running?
 bool vbase_loop();
-// renders screen
+// queues fb_back to be shown; does not wait for it to be presented
 void vbase_flip();
+// shows the same frame as the last flip for another frame; fb_back and the
+// fade level have not changed since
+void vbase_repeat();
+// if another frame could be shown before the next tick, returns true and
+// sets blend to where that frame falls between the previous tick (0) and
+// the latest one (1). with wait, first waits until it is time to draw it;
+// without, it is about the frame drawn right after a tick.
+bool vbase_next_refresh(double &blend, bool wait);
+// how far it is past the time the next tick should start, in ticks;
+// negative if there is still time left
+double vbase_lateness();
 // waits for tick to expire
 void vbase_sync();
 void vbase_quit();
@@ -0,0 +1,295 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// binrender.cc: tile-binned deferred rendering
+
+#include <algorithm>
+#include "binrender.hh"
+
+// worker threads in addition to the thread calling end()
+constexpr unsigned MAX_RENDER_WORKERS = 3;
+
+void DrawList::clear()
+{
+    _commands.clear();
+    _lines.clear();
+    _passes.clear();
+    _produced.clear();
+}
+
+std::shared_ptr<Image> DrawList::source(Image *src)
+{
+    if (_snapshots && std::find(_produced.begin(), _produced.end(), src)
+                        == _produced.end())
+        return src->snapshot();
+    return src->weak_from_this().lock();
+}
+
+void DrawList::add(DrawOp op, Image *src, int dx, int dy,
+                int sx, int sy, int sw, int sh, Color shade)
+{
+    std::shared_ptr<Image> keep = source(src);
+    if (keep)
+        src = keep.get();
+    _commands.push_back({ op, src, std::move(keep),
+                          dx, dy, sx, sy, sw, sh, shade, 0, nullptr });
+}
+
+void DrawList::addRaster(DrawOp op, Image *src, int dx, int dy, int sw,
+                const RasterLine *lines, int count)
+{
+    std::shared_ptr<Image> keep = source(src);
+    if (keep)
+        src = keep.get();
+    _commands.push_back({ op, src, std::move(keep), dx, dy, 0, 0, sw, count,
+                          Color(), _lines.size(), nullptr });
+    _lines.insert(_lines.end(), lines, lines + std::max(count, 0));
+}
+
+void DrawList::addColor(DrawOp op, Color color, int x, int y, int w, int h)
+{
+    _commands.push_back({ op, nullptr, nullptr,
+                          x, y, 0, 0, w, h, color, 0, nullptr });
+}
+
+void DrawList::addPass(BinnedRenderer &pass, Image &target, DrawList &&list)
+{
+    _commands.push_back({ DrawOp::Pass, nullptr, nullptr, 0, 0, 0, 0, 0, 0,
+                          Color(), _passes.size(), &pass });
+    _passes.push_back(std::move(list));
+    _produced.push_back(&target);
+}
+
+void DrawList::draw(Image &dst) const
+{
+    for (const DrawCommand &cmd : _commands)
+        draw(dst, cmd, 0, 0);
+}
+
+// a rectangle that contains every pixel the command may draw to
+static bool commandBounds(const DrawCommand &cmd, int width, int height,
+                int &x0, int &y0, int &x1, int &y1)
+{
+    switch (cmd.op)
+    {
+    case DrawOp::Blit:
+    case DrawOp::BlitFast:
+    case DrawOp::BlitAdditive:
+    case DrawOp::BlitModulated:
+    case DrawOp::BlitFastModulated:
+    case DrawOp::BlitAdditiveModulated:
+        // negative source coordinates move the destination instead
+        x0 = cmd.dx + std::max(0, -cmd.sx);
+        y0 = cmd.dy + std::max(0, -cmd.sy);
+        x1 = x0 + cmd.sw;
+        y1 = y0 + cmd.sh;
+        break;
+    case DrawOp::BlitRaster:
+        x0 = cmd.dx, y0 = cmd.dy;
+        x1 = width;
+        y1 = y0 + cmd.sh;
+        break;
+    default:
+        x0 = cmd.dx, y0 = cmd.dy;
+        x1 = x0 + cmd.sw;
+        y1 = y0 + cmd.sh;
+        break;
+    }
+    x0 = std::max(x0, 0), y0 = std::max(y0, 0);
+    x1 = std::min(x1, width), y1 = std::min(y1, height);
+    return x0 < x1 && y0 < y1;
+}
+
+// every blit maps destination pixels to the same source pixels however it
+// is clipped, so only the destination coordinates need to be moved.
+void DrawList::draw(Image &dst, const DrawCommand &cmd, int ox, int oy) const
+{
+    int dx = cmd.dx - ox, dy = cmd.dy - oy;
+    switch (cmd.op)
+    {
+    case DrawOp::Blit:
+        cmd.src->blit(dst, dx, dy, cmd.sx, cmd.sy, cmd.sw, cmd.sh);
+        break;
+    case DrawOp::BlitTiled:
+        cmd.src->blitTiled(dst, dx, dy, cmd.sx, cmd.sy, cmd.sw, cmd.sh);
+        break;
+    case DrawOp::BlitFast:
+        cmd.src->blitFast(dst, dx, dy, cmd.sx, cmd.sy, cmd.sw, cmd.sh);
+        break;
+    case DrawOp::BlitAdditive:
+        cmd.src->blitAdditive(dst, dx, dy, cmd.sx, cmd.sy, cmd.sw, cmd.sh);
+        break;
+    case DrawOp::BlitAdditiveTiled:
+        cmd.src->blitAdditiveTiled(dst, dx, dy,
+                cmd.sx, cmd.sy, cmd.sw, cmd.sh);
+        break;
+    case DrawOp::BlitModulated:
+        cmd.src->blitModulated(dst, dx, dy,
+                cmd.sx, cmd.sy, cmd.sw, cmd.sh, cmd.color);
+        break;
+    case DrawOp::BlitFastModulated:
+        cmd.src->blitFastModulated(dst, dx, dy,
+                cmd.sx, cmd.sy, cmd.sw, cmd.sh, cmd.color);
+        break;
+    case DrawOp::BlitAdditiveModulated:
+        cmd.src->blitAdditiveModulated(dst, dx, dy,
+                cmd.sx, cmd.sy, cmd.sw, cmd.sh, cmd.color);
+        break;
+    case DrawOp::BlitRaster:
+        cmd.src->blitRaster(dst, dx, dy, cmd.sw, lines(cmd), cmd.sh);
+        break;
+    case DrawOp::BlitRasterTiled:
+        cmd.src->blitRasterTiled(dst, dx, dy, cmd.sw, lines(cmd), cmd.sh);
+        break;
+    case DrawOp::Add:
+        dst.add(cmd.color, dx, dy, cmd.sw, cmd.sh);
+        break;
+    case DrawOp::Subtract:
+        dst.subtract(cmd.color, dx, dy, cmd.sw, cmd.sh);
+        break;
+    case DrawOp::Clear:
+        dst.clear(dx, dy, cmd.sw, cmd.sh);
+        break;
+    case DrawOp::Pass:
+        cmd.pass->draw(_passes[cmd.line]);
+        break;
+    }
+}
+
+BinnedRenderer::BinnedRenderer(Image &target)
+    : _target(target),
+      _columns((target.width() + TileWidth - 1) / TileWidth),
+      _rows((target.height() + TileHeight - 1) / TileHeight),
+      _drawing(nullptr), _bins(_columns * _rows), _pixels(nullptr),
+      _tile(TileWidth, TileHeight),
+      _generation(0), _busy(0), _quit(false), _nextTile(0)
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    unsigned workers = std::min(cores ? cores - 1 : 0, MAX_RENDER_WORKERS);
+    for (unsigned i = 0; i < workers; ++i)
+        _workers.emplace_back(&BinnedRenderer::workerLoop, this);
+}
+
+BinnedRenderer::~BinnedRenderer()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wake.notify_all();
+    for (auto &worker : _workers)
+        worker.join();
+}
+
+void BinnedRenderer::begin(const Image &fb)
+{
+    _list.clear();
+    _list.setSnapshots(fb.recorder() != nullptr);
+    _target.setRecorder(&_list);
+}
+
+void BinnedRenderer::end(Image &fb)
+{
+    _target.setRecorder(nullptr);
+    if (fb.recorder())
+        fb.recorder()->addPass(*this, _target, std::move(_list));
+    else
+        draw(_list);
+    _list.clear();
+}
+
+void BinnedRenderer::draw(const DrawList &list)
+{
+    _drawing = &list;
+    bin();
+    _pixels = _target.buffer().data();
+    _nextTile = 0;
+    if (!_workers.empty())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_generation;
+            _busy = _workers.size();
+        }
+        _wake.notify_all();
+    }
+    drawTiles(_tile);
+    if (!_workers.empty())
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [this] { return _busy == 0; });
+    }
+    _drawing = nullptr;
+}
+
+void BinnedRenderer::bin()
+{
+    for (auto &bin : _bins)
+        bin.clear();
+    const auto &commands = _drawing->commands();
+    int width = _target.width(), height = _target.height();
+    int x0, y0, x1, y1;
+    for (int i = 0, n = commands.size(); i < n; ++i)
+    {
+        if (!commandBounds(commands[i], width, height, x0, y0, x1, y1))
+            continue;
+        for (int ty = y0 / TileHeight; ty <= (y1 - 1) / TileHeight; ++ty)
+            for (int tx = x0 / TileWidth; tx <= (x1 - 1) / TileWidth; ++tx)
+                _bins[ty * _columns + tx].push_back(i);
+    }
+}
+
+void BinnedRenderer::drawTiles(Image &tile)
+{
+    int count = _bins.size();
+    for (int i; (i = _nextTile++) < count; )
+        drawTile(tile, i);
+}
+
+void BinnedRenderer::drawTile(Image &tile, int index)
+{
+    const std::vector<int> &bin = _bins[index];
+    if (bin.empty())
+        return;
+    int fbs = _target.width();
+    int ox = (index % _columns) * TileWidth;
+    int oy = (index / _columns) * TileHeight;
+    int w = std::min(TileWidth, fbs - ox);
+    int h = std::min(TileHeight, _target.height() - oy);
+    Color *pixels = tile.buffer().data();
+    Color *area = _pixels + (oy * fbs + ox);
+
+    for (int y = 0; y < h; ++y)
+        std::copy(area + y * fbs, area + y * fbs + w, pixels + y * TileWidth);
+    const auto &commands = _drawing->commands();
+    for (int i : bin)
+        _drawing->draw(tile, commands[i], ox, oy);
+    for (int y = 0; y < h; ++y)
+        std::copy(pixels + y * TileWidth, pixels + y * TileWidth + w,
+                  area + y * fbs);
+}
+
+void BinnedRenderer::workerLoop()
+{
+    Image tile(TileWidth, TileHeight);
+    unsigned long seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&] { return _quit || _generation != seen; });
+            if (_quit)
+                return;
+            seen = _generation;
+        }
+        drawTiles(tile);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!--_busy)
+                _done.notify_one();
+        }
+    }
+}
@@ -0,0 +1,475 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// blit.cc: per-row pixel kernels with runtime CPU dispatch
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if (defined(__GNUC__) || defined(__clang__)) \
+        && (defined(__x86_64__) || defined(__i386__))
+#define M_BLIT_X86 1
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+// 8 and 16 colors per vector
+typedef std::uint16_t ColorVec8 __attribute__((vector_size(16)));
+typedef std::uint16_t ColorVec16 __attribute__((vector_size(32)));
+// the vector code is always inlined into functions built for the right
+// target, so the ABI of vectors passed by value never matters
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+#include "blit.hh"
+
+// all ones where the pixel is transparent
+static inline REALLY_INLINE std::uint16_t zeroMask(std::uint16_t x)
+{
+    return x ? 0x0000 : 0xFFFF;
+}
+
+template <class V>
+static inline REALLY_INLINE V zeroMask(V x)
+{
+    return (V)(x == 0);
+}
+
+// all ones where the pixels are equal
+static inline REALLY_INLINE std::uint16_t equalMask(std::uint16_t a,
+                                                    std::uint16_t b)
+{
+    return a == b ? 0xFFFF : 0x0000;
+}
+
+template <class V>
+static inline REALLY_INLINE V equalMask(V a, V b)
+{
+    return (V)(a == b);
+}
+
+// a where the mask is set, b elsewhere
+template <class T>
+static inline REALLY_INLINE T select(T mask, T a, T b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+// stores a[i] and b[i] alternately to dst
+static inline REALLY_INLINE void storeInterleaved(Color *dst,
+                                    std::uint16_t a, std::uint16_t b)
+{
+    dst[0].v = a;
+    dst[1].v = b;
+}
+
+template <class V>
+static inline REALLY_INLINE void storeInterleaved(Color *dst, V a, V b)
+{
+    // widening to 32 bits puts b in the upper half of each lane
+    typedef std::uint32_t W __attribute__((vector_size(2 * sizeof(V))));
+    W w = __builtin_convertvector(a, W)
+        | (__builtin_convertvector(b, W) << 16);
+    std::memcpy(static_cast<void *>(dst), &w, sizeof(W));
+}
+
+// stores a[i], b[i] and c[i] in turn to dst
+template <class T>
+static inline REALLY_INLINE void storeInterleaved(Color *dst, T a, T b, T c)
+{
+    constexpr int step = sizeof(T) / sizeof(Color);
+    std::uint16_t la[step], lb[step], lc[step];
+    std::memcpy(la, &a, sizeof(T));
+    std::memcpy(lb, &b, sizeof(T));
+    std::memcpy(lc, &c, sizeof(T));
+    for (int i = 0; i < step; ++i)
+    {
+        dst[i * 3 + 0].v = la[i];
+        dst[i * 3 + 1].v = lb[i];
+        dst[i * 3 + 2].v = lc[i];
+    }
+}
+
+// the per-pixel operations, written once for scalars and vectors
+struct OpTransparent
+{
+    template <class T>
+    static inline REALLY_INLINE T apply(T d, T s)
+    {
+        // transparent pixels are zero, so no select is needed
+        return s | (d & zeroMask(s));
+    }
+};
+
+struct OpAdd
+{
+    template <class T>
+    static inline REALLY_INLINE T apply(T d, T s)
+    {
+        return ColorAddPacked(d, s);
+    }
+};
+
+// keeps the top four bits of d, like Color::operator+=, so adding onto a
+// transparent pixel leaves it transparent
+struct OpAddKeep
+{
+    template <class T>
+    static constexpr REALLY_INLINE T apply(T d, T s)
+    {
+        return (d & 0xF000) | (ColorAddPacked(d, s) & 0x0FFF);
+    }
+};
+
+static_assert(OpAddKeep::apply<std::uint16_t>(0x0000, 0x0000) == 0x0000,
+              "transparent plus transparent must stay transparent");
+static_assert(OpAddKeep::apply<std::uint16_t>(0x0123, 0x8456) == 0x0579,
+              "a transparent pixel must stay transparent");
+static_assert(OpAddKeep::apply<std::uint16_t>(0x8F00, 0x0234) == 0x8F34,
+              "an opaque pixel must stay opaque");
+
+struct OpSubtract
+{
+    template <class T>
+    static inline REALLY_INLINE T apply(T d, T s)
+    {
+        return ColorSubtractPacked(d, s);
+    }
+};
+
+struct OpAddSolid
+{
+    template <class T>
+    static inline REALLY_INLINE T apply(T d, T s)
+    {
+        return ColorAddPacked(d, s) & ~zeroMask(d);
+    }
+};
+
+struct OpSubtractSolid
+{
+    template <class T>
+    static inline REALLY_INLINE T apply(T d, T s)
+    {
+        return ColorSubtractPacked(d, s) & ~zeroMask(d);
+    }
+};
+
+// the source pixel is darkened by c before it is combined with d
+struct OpTransparentModulated
+{
+    template <class T>
+    static inline REALLY_INLINE T apply(T d, T s, T c)
+    {
+        T m = zeroMask(s);
+        return (ColorSubtractPacked(s, c) & ~m) | (d & m);
+    }
+};
+
+struct OpAddModulated
+{
+    template <class T>
+    static inline REALLY_INLINE T apply(T d, T s, T c)
+    {
+        return ColorAddPacked(d, ColorSubtractPacked(s, c));
+    }
+};
+
+struct OpHalve
+{
+    template <class T>
+    static inline REALLY_INLINE T apply(T d, T s)
+    {
+        // the top bit of each channel is masked off after the shift, so
+        // that nothing moves over from the channel above
+        return (d & ~s) | ((d >> 1) & s & 0x0777);
+    }
+};
+
+template <class V, class Op>
+static inline REALLY_INLINE void rowBinary(Color *dst, const Color *src,
+                                            int n)
+{
+    constexpr int step = sizeof(V) / sizeof(Color);
+    V d, s;
+    int i = 0;
+    for (; i + step <= n; i += step)
+    {
+        // memcpy compiles to unaligned vector loads and stores
+        std::memcpy(&d, static_cast<const void *>(dst + i), sizeof(V));
+        std::memcpy(&s, static_cast<const void *>(src + i), sizeof(V));
+        d = Op::apply(d, s);
+        std::memcpy(static_cast<void *>(dst + i), &d, sizeof(V));
+    }
+    for (; i < n; ++i)
+        dst[i].v = Op::apply(dst[i].v, src[i].v);
+}
+
+template <class V, class Op>
+static inline REALLY_INLINE void rowColor(Color *dst, int n, Color color)
+{
+    constexpr int step = sizeof(V) / sizeof(Color);
+    const V c = V{} + color.v;
+    V d;
+    int i = 0;
+    for (; i + step <= n; i += step)
+    {
+        std::memcpy(&d, static_cast<const void *>(dst + i), sizeof(V));
+        d = Op::apply(d, c);
+        std::memcpy(static_cast<void *>(dst + i), &d, sizeof(V));
+    }
+    for (; i < n; ++i)
+        dst[i].v = Op::apply(dst[i].v, color.v);
+}
+
+template <class V, class Op>
+static inline REALLY_INLINE void rowCopyColor(Color *dst, const Color *src,
+                                            int n, Color color)
+{
+    constexpr int step = sizeof(V) / sizeof(Color);
+    const V c = V{} + color.v;
+    V d;
+    int i = 0;
+    for (; i + step <= n; i += step)
+    {
+        std::memcpy(&d, static_cast<const void *>(src + i), sizeof(V));
+        d = Op::apply(d, c);
+        std::memcpy(static_cast<void *>(dst + i), &d, sizeof(V));
+    }
+    for (; i < n; ++i)
+        dst[i].v = Op::apply(src[i].v, color.v);
+}
+
+template <class V, class Op>
+static inline REALLY_INLINE void rowTernary(Color *dst, const Color *src,
+                                            int n, Color color)
+{
+    constexpr int step = sizeof(V) / sizeof(Color);
+    const V c = V{} + color.v;
+    V d, s;
+    int i = 0;
+    for (; i + step <= n; i += step)
+    {
+        std::memcpy(&d, static_cast<const void *>(dst + i), sizeof(V));
+        std::memcpy(&s, static_cast<const void *>(src + i), sizeof(V));
+        d = Op::apply(d, s, c);
+        std::memcpy(static_cast<void *>(dst + i), &d, sizeof(V));
+    }
+    for (; i < n; ++i)
+        dst[i].v = Op::apply(dst[i].v, src[i].v, color.v);
+}
+
+// the neighbors of the pixels at x: A B C above, D E F on the row and
+// G H I below
+template <class V>
+struct Neighbors
+{
+    V a, b, c, d, e, f, g, h, i;
+
+    inline REALLY_INLINE Neighbors(const Color *above, const Color *row,
+                                    const Color *below, int x)
+    {
+        load(a, above + x - 1), load(b, above + x), load(c, above + x + 1);
+        load(d, row + x - 1), load(e, row + x), load(f, row + x + 1);
+        load(g, below + x - 1), load(h, below + x), load(i, below + x + 1);
+    }
+
+    static inline REALLY_INLINE void load(V &v, const Color *src)
+    {
+        std::memcpy(&v, static_cast<const void *>(src), sizeof(V));
+    }
+};
+
+// Scale2x, also known as EPX: corners take the color of the two edges
+// next to them where those agree, unless the whole area is one shape
+template <class V>
+static inline REALLY_INLINE void scale2xPixels(Color *out0, Color *out1,
+                const Color *above, const Color *row, const Color *below,
+                int x)
+{
+    Neighbors<V> p(above, row, below, x);
+    V edge = ~equalMask(p.b, p.h) & ~equalMask(p.d, p.f);
+    V e0 = select<V>(edge & equalMask(p.d, p.b), p.d, p.e);
+    V e1 = select<V>(edge & equalMask(p.b, p.f), p.f, p.e);
+    V e2 = select<V>(edge & equalMask(p.d, p.h), p.d, p.e);
+    V e3 = select<V>(edge & equalMask(p.h, p.f), p.f, p.e);
+    storeInterleaved(out0 + 2 * x, e0, e1);
+    storeInterleaved(out1 + 2 * x, e2, e3);
+}
+
+template <class V>
+static inline REALLY_INLINE void rowScale2x(Color *const *out,
+                const Color *above, const Color *row, const Color *below,
+                int n)
+{
+    constexpr int step = sizeof(V) / sizeof(Color);
+    int x = 0;
+    for (; x + step <= n; x += step)
+        scale2xPixels<V>(out[0], out[1], above, row, below, x);
+    for (; x < n; ++x)
+        scale2xPixels<std::uint16_t>(out[0], out[1], above, row, below, x);
+}
+
+// Scale3x, the same idea with an edge pixel between each two corners
+template <class V>
+static inline REALLY_INLINE void scale3xPixels(Color *const *out,
+                const Color *above, const Color *row, const Color *below,
+                int x)
+{
+    Neighbors<V> p(above, row, below, x);
+    V edge = ~equalMask(p.b, p.h) & ~equalMask(p.d, p.f);
+    V db = edge & equalMask(p.d, p.b), bf = edge & equalMask(p.b, p.f);
+    V dh = edge & equalMask(p.d, p.h), hf = edge & equalMask(p.h, p.f);
+    V ea = ~equalMask(p.e, p.a), ec = ~equalMask(p.e, p.c);
+    V eg = ~equalMask(p.e, p.g), ei = ~equalMask(p.e, p.i);
+    storeInterleaved<V>(out[0] + 3 * x,
+            select<V>(db, p.d, p.e),
+            select<V>((db & ec) | (bf & ea), p.b, p.e),
+            select<V>(bf, p.f, p.e));
+    storeInterleaved<V>(out[1] + 3 * x,
+            select<V>((db & eg) | (dh & ea), p.d, p.e),
+            p.e,
+            select<V>((bf & ei) | (hf & ec), p.f, p.e));
+    storeInterleaved<V>(out[2] + 3 * x,
+            select<V>(dh, p.d, p.e),
+            select<V>((dh & ei) | (hf & eg), p.h, p.e),
+            select<V>(hf, p.f, p.e));
+}
+
+template <class V>
+static inline REALLY_INLINE void rowScale3x(Color *const *out,
+                const Color *above, const Color *row, const Color *below,
+                int n)
+{
+    constexpr int step = sizeof(V) / sizeof(Color);
+    int x = 0;
+    for (; x + step <= n; x += step)
+        scale3xPixels<V>(out, above, row, below, x);
+    for (; x < n; ++x)
+        scale3xPixels<std::uint16_t>(out, above, row, below, x);
+}
+
+template <class V>
+static inline REALLY_INLINE void rowExpand(Color *dst, const Color *src,
+                                            int n, int factor)
+{
+    constexpr int step = sizeof(V) / sizeof(Color);
+    V s;
+    int x = 0;
+    if (factor == 2)
+    {
+        for (; x + step <= n; x += step)
+        {
+            std::memcpy(&s, static_cast<const void *>(src + x), sizeof(V));
+            storeInterleaved(dst + 2 * x, s, s);
+        }
+    }
+    for (; x < n; ++x)
+        std::fill(dst + factor * x, dst + factor * (x + 1), src[x]);
+}
+
+#define M_DEFINE_KERNELS(suffix, V, target)                                 \
+    target static void blitRowTransparent##suffix(Color *dst,               \
+                        const Color *src, int n)                            \
+    { rowBinary<V, OpTransparent>(dst, src, n); }                           \
+    target static void blitRowAdditive##suffix(Color *dst,                  \
+                        const Color *src, int n)                            \
+    { rowBinary<V, OpAdd>(dst, src, n); }                                   \
+    target static void blitRowAdditiveKeep##suffix(Color *dst,              \
+                        const Color *src, int n)                            \
+    { rowBinary<V, OpAddKeep>(dst, src, n); }                               \
+    target static void colorRowAdd##suffix(Color *dst, int n, Color c)      \
+    { rowColor<V, OpAdd>(dst, n, c); }                                      \
+    target static void colorRowSubtract##suffix(Color *dst, int n, Color c) \
+    { rowColor<V, OpSubtract>(dst, n, c); }                                 \
+    target static void colorRowAddSolid##suffix(Color *dst, int n, Color c) \
+    { rowColor<V, OpAddSolid>(dst, n, c); }                                 \
+    target static void colorRowSubtractSolid##suffix(Color *dst,            \
+                        int n, Color c)                                     \
+    { rowColor<V, OpSubtractSolid>(dst, n, c); }                            \
+    target static void colorRowCopySubtract##suffix(Color *dst,             \
+                        const Color *src, int n, Color c)                   \
+    { rowCopyColor<V, OpSubtract>(dst, src, n, c); }                       \
+    target static void blitRowModulated##suffix(Color *dst,                 \
+                        const Color *src, int n, Color c)                   \
+    { rowTernary<V, OpTransparentModulated>(dst, src, n, c); }              \
+    target static void blitRowAdditiveModulated##suffix(Color *dst,         \
+                        const Color *src, int n, Color c)                   \
+    { rowTernary<V, OpAddModulated>(dst, src, n, c); }                      \
+    target static void blitRowHalve##suffix(Color *dst,                     \
+                        const Color *src, int n)                            \
+    { rowBinary<V, OpHalve>(dst, src, n); }                                 \
+    target static void scale2xRow##suffix(Color *const *out,                \
+                        const Color *above, const Color *row,               \
+                        const Color *below, int n)                          \
+    { rowScale2x<V>(out, above, row, below, n); }                           \
+    target static void scale3xRow##suffix(Color *const *out,                \
+                        const Color *above, const Color *row,               \
+                        const Color *below, int n)                          \
+    { rowScale3x<V>(out, above, row, below, n); }                           \
+    target static void expandRow##suffix(Color *dst, const Color *src,      \
+                        int n, int factor)                                  \
+    { rowExpand<V>(dst, src, n, factor); }
+
+#define M_USE_KERNELS(suffix)                                               \
+    BlitRowTransparent = blitRowTransparent##suffix;                        \
+    BlitRowAdditive = blitRowAdditive##suffix;                              \
+    BlitRowAdditiveKeep = blitRowAdditiveKeep##suffix;                      \
+    ColorRowAdd = colorRowAdd##suffix;                                      \
+    ColorRowSubtract = colorRowSubtract##suffix;                            \
+    ColorRowAddSolid = colorRowAddSolid##suffix;                            \
+    ColorRowSubtractSolid = colorRowSubtractSolid##suffix;                  \
+    ColorRowCopySubtract = colorRowCopySubtract##suffix;                    \
+    BlitRowModulated = blitRowModulated##suffix;                            \
+    BlitRowAdditiveModulated = blitRowAdditiveModulated##suffix;            \
+    BlitRowHalve = blitRowHalve##suffix;                                    \
+    Scale2xRow = scale2xRow##suffix;                                        \
+    Scale3xRow = scale3xRow##suffix;                                        \
+    ExpandRow = expandRow##suffix;
+
+M_DEFINE_KERNELS(Scalar, std::uint16_t, )
+#ifdef M_BLIT_X86
+M_DEFINE_KERNELS(SSE2, ColorVec8, TARGET_SSE2)
+M_DEFINE_KERNELS(AVX2, ColorVec16, TARGET_AVX2)
+#endif
+
+BlitRowKernel BlitRowTransparent = blitRowTransparentScalar;
+BlitRowKernel BlitRowAdditive = blitRowAdditiveScalar;
+BlitRowKernel BlitRowAdditiveKeep = blitRowAdditiveKeepScalar;
+ColorRowKernel ColorRowAdd = colorRowAddScalar;
+ColorRowKernel ColorRowSubtract = colorRowSubtractScalar;
+ColorRowKernel ColorRowAddSolid = colorRowAddSolidScalar;
+ColorRowKernel ColorRowSubtractSolid = colorRowSubtractSolidScalar;
+ColorCopyKernel ColorRowCopySubtract = colorRowCopySubtractScalar;
+ColorCopyKernel BlitRowModulated = blitRowModulatedScalar;
+ColorCopyKernel BlitRowAdditiveModulated = blitRowAdditiveModulatedScalar;
+BlitRowKernel BlitRowHalve = blitRowHalveScalar;
+Scale2xRowKernel Scale2xRow = scale2xRowScalar;
+Scale3xRowKernel Scale3xRow = scale3xRowScalar;
+ExpandRowKernel ExpandRow = expandRowScalar;
+static const char *kernelName = "scalar";
+
+void InitBlitKernels()
+{
+#ifdef M_BLIT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        M_USE_KERNELS(AVX2)
+        kernelName = "AVX2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        M_USE_KERNELS(SSE2)
+        kernelName = "SSE2";
+    }
+#endif
+    DEBUG_LOG("Using ", kernelName, " blit kernels");
+}
+
+const char *GetBlitKernelName()
+{
+    return kernelName;
+}
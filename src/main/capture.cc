@@ -0,0 +1,298 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// capture.cc: recording the shown frames to a file
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "capture.hh"
+#include "render.hh"
+#include "blit.hh"
+
+std::string captureFile;
+
+// the file starts with the eight characters "MPXCAPT1", then the width,
+// height and frames per second as 16-bit little-endian integers. each
+// frame follows as its size in bytes, a 32-bit little-endian integer, and
+// then that many bytes of runs. a run starts with a 16-bit little-endian
+// word, the top two bits of which give its kind and the rest the number
+// of pixels in it less one:
+//     0: the pixels are the same as in the previous frame
+//     1: the pixels are all of the color in the next word
+//     2: the pixels are of the colors in the next words, one each
+// colors are stored as in Color. the frame before the first one is all
+// zero, and a frame of no bytes is the same as the one before it.
+static const char captureMagic[8] = { 'M','P','X','C','A','P','T','1' };
+constexpr int RUN_SAME = 0;
+constexpr int RUN_FILL = 1;
+constexpr int RUN_COPY = 2;
+constexpr int MAX_RUN = 1 << 14;
+// a fill is only started for at least this many pixels of the same color
+constexpr int MIN_FILL = 3;
+constexpr int FRAME_PIXELS = S_WIDTH * S_HEIGHT;
+
+// about half a second of frames can be queued before they are dropped
+constexpr unsigned CAPTURE_SLOTS = 32;
+// the encoder does not rely on being woken up, as the game thread never
+// takes the lock; it looks at the queue at least this often
+constexpr std::chrono::milliseconds ENCODER_POLL{4};
+
+struct CaptureSlot
+{
+    std::vector<Color> pixels;
+    int fade;
+    // the frame is the same as the one queued before it; pixels are unset
+    bool repeat;
+    // frames dropped just before this one; written as repeats of the one
+    // before them to keep the timing
+    unsigned dropsBefore;
+};
+
+// slots from ringTail up to ringHead are queued. only the game thread
+// moves ringHead and only the encoder ringTail, so neither waits for the
+// other; a slot is not touched by the game thread while it is queued
+static std::array<CaptureSlot, CAPTURE_SLOTS> slots;
+static std::atomic<unsigned> ringHead{0};
+static std::atomic<unsigned> ringTail{0};
+static std::atomic<bool> encoderQuit{false};
+static std::thread encoderThread;
+static std::mutex encoderMutex;
+static std::condition_variable encoderWake;
+static std::ofstream captureStream;
+
+// only used on the game thread
+static bool changedSinceCapture;
+static unsigned pendingDrops;
+static unsigned long framesQueued, framesDropped;
+// only used on the encoder thread until it is joined
+static unsigned long framesWritten, framesRepeated;
+static unsigned long long bytesWritten;
+
+static inline void PutWord(std::vector<std::uint8_t> &out, unsigned v)
+{
+    out.push_back(v & 0xFF);
+    out.push_back((v >> 8) & 0xFF);
+}
+
+static inline void PutRun(std::vector<std::uint8_t> &out, int kind, int n)
+{
+    PutWord(out, (kind << 14) | (n - 1));
+}
+
+// length of the run of pixels from i with the same color as cur[i]
+static inline int FillLength(const Color *cur, int i, int n)
+{
+    int j = i + 1;
+    while (j < n && j - i < MAX_RUN && cur[j].v == cur[i].v)
+        ++j;
+    return j - i;
+}
+
+// appends the runs that turn prev into cur
+static void EncodeFrame(std::vector<std::uint8_t> &out,
+                        const Color *prev, const Color *cur, int n)
+{
+    int i = 0;
+    while (i < n)
+    {
+        int j = i;
+        if (cur[i].v == prev[i].v)
+        {
+            while (j < n && j - i < MAX_RUN && cur[j].v == prev[j].v)
+                ++j;
+            PutRun(out, RUN_SAME, j - i);
+            i = j;
+            continue;
+        }
+        int fill = FillLength(cur, i, n);
+        if (fill >= MIN_FILL)
+        {
+            PutRun(out, RUN_FILL, fill);
+            PutWord(out, cur[i].v);
+            i += fill;
+            continue;
+        }
+        // a copy ends where a same run of two or a fill could start
+        ++j;
+        while (j < n && j - i < MAX_RUN
+                && !(j + 1 < n && cur[j].v == prev[j].v
+                               && cur[j + 1].v == prev[j + 1].v)
+                && !(j + MIN_FILL <= n && FillLength(cur, j, j + MIN_FILL)
+                                            >= MIN_FILL))
+            ++j;
+        PutRun(out, RUN_COPY, j - i);
+        for (; i < j; ++i)
+            PutWord(out, cur[i].v);
+    }
+}
+
+static void WriteRecord(const std::vector<std::uint8_t> &data)
+{
+    std::uint8_t size[4];
+    for (int i = 0; i < 4; ++i)
+        size[i] = (data.size() >> (8 * i)) & 0xFF;
+    captureStream.write(reinterpret_cast<const char *>(size), sizeof(size));
+    captureStream.write(reinterpret_cast<const char *>(data.data()),
+                        data.size());
+    bytesWritten += sizeof(size) + data.size();
+    ++framesWritten;
+}
+
+static void EncoderLoop()
+{
+    std::vector<Color> prev(FRAME_PIXELS), cur(FRAME_PIXELS);
+    std::vector<std::uint8_t> out, empty;
+    out.reserve(FRAME_PIXELS * sizeof(Color));
+    for (;;)
+    {
+        // nothing more is queued once quitting, so if the queue is empty
+        // after that has been seen, it stays empty
+        bool quit = encoderQuit.load(std::memory_order_acquire);
+        unsigned tail = ringTail.load(std::memory_order_relaxed);
+        if (tail == ringHead.load(std::memory_order_acquire))
+        {
+            if (quit)
+                break;
+            std::unique_lock<std::mutex> lock(encoderMutex);
+            encoderWake.wait_for(lock, ENCODER_POLL);
+            continue;
+        }
+        CaptureSlot &slot = slots[tail % CAPTURE_SLOTS];
+        framesRepeated += slot.dropsBefore;
+        for (unsigned i = 0; i < slot.dropsBefore; ++i)
+            WriteRecord(empty);
+        if (slot.repeat)
+        {
+            ++framesRepeated;
+            WriteRecord(empty);
+        }
+        else
+        {
+            if (slot.fade)
+                ColorRowCopySubtract(cur.data(), slot.pixels.data(),
+                    FRAME_PIXELS, Color(slot.fade, slot.fade, slot.fade));
+            else
+                std::memcpy(cur.data(), slot.pixels.data(),
+                            FRAME_PIXELS * sizeof(Color));
+            out.clear();
+            // a frame that came out the same is stored as a repeat
+            if (!std::memcmp(cur.data(), prev.data(),
+                             FRAME_PIXELS * sizeof(Color)))
+                ++framesRepeated;
+            else
+                EncodeFrame(out, prev.data(), cur.data(), FRAME_PIXELS);
+            WriteRecord(out);
+            prev.swap(cur);
+        }
+        ringTail.store(tail + 1, std::memory_order_release);
+    }
+}
+
+static void WriteHeader()
+{
+    std::uint8_t header[6];
+    int fields[3] = { S_WIDTH, S_HEIGHT, S_TICKS };
+    for (int i = 0; i < 3; ++i)
+    {
+        header[2 * i] = fields[i] & 0xFF;
+        header[2 * i + 1] = (fields[i] >> 8) & 0xFF;
+    }
+    captureStream.write(captureMagic, sizeof(captureMagic));
+    captureStream.write(reinterpret_cast<const char *>(header),
+                        sizeof(header));
+}
+
+void StartCapture()
+{
+    if (captureFile.empty() || encoderThread.joinable())
+        return;
+    captureStream.open(captureFile, std::ios::binary | std::ios::trunc);
+    if (captureStream.fail())
+    {
+        DEBUG_LOG("Cannot open capture file ", captureFile);
+        return;
+    }
+    WriteHeader();
+    for (CaptureSlot &slot : slots)
+        slot.pixels.resize(FRAME_PIXELS);
+    ringHead = ringTail = 0;
+    encoderQuit = false;
+    changedSinceCapture = true;
+    pendingDrops = 0;
+    framesQueued = framesDropped = framesWritten = framesRepeated = 0;
+    bytesWritten = 0;
+    encoderThread = std::thread(EncoderLoop);
+}
+
+// queues the frame in fb_back, or a repeat of the one before it if copy is
+// false; returns false if the queue was full and the frame was dropped
+static bool QueueFrame(bool copy)
+{
+    unsigned head = ringHead.load(std::memory_order_relaxed);
+    if (head - ringTail.load(std::memory_order_acquire) >= CAPTURE_SLOTS)
+    {
+        ++pendingDrops;
+        ++framesDropped;
+        return false;
+    }
+    CaptureSlot &slot = slots[head % CAPTURE_SLOTS];
+    slot.repeat = !copy;
+    slot.dropsBefore = pendingDrops;
+    if (copy)
+    {
+        std::memcpy(slot.pixels.data(), fb_back.pixels(),
+                    FRAME_PIXELS * sizeof(Color));
+        slot.fade = GetFadeLevel();
+    }
+    pendingDrops = 0;
+    ++framesQueued;
+    ringHead.store(head + 1, std::memory_order_release);
+    encoderWake.notify_one();
+    return true;
+}
+
+void CaptureFrame(bool changed)
+{
+    if (!encoderThread.joinable())
+        return;
+    changedSinceCapture = changedSinceCapture || changed;
+    if (renderBetweenTicks)
+        return;
+    // the frame last queued may not be the one last shown if any were
+    // dropped since
+    if (QueueFrame(changedSinceCapture || pendingDrops))
+        changedSinceCapture = false;
+}
+
+// the frame shown last may still be drawn over by the render thread, so
+// the one queued last is repeated instead
+void CaptureSkippedFrame()
+{
+    if (encoderThread.joinable())
+        QueueFrame(false);
+}
+
+void StopCapture()
+{
+    if (!encoderThread.joinable())
+        return;
+    encoderQuit.store(true, std::memory_order_release);
+    encoderWake.notify_one();
+    encoderThread.join();
+    captureStream.close();
+    for (CaptureSlot &slot : slots)
+        std::vector<Color>().swap(slot.pixels);
+    DEBUG_LOG("Captured ", framesWritten, " frames (", framesRepeated,
+            " repeated) to ", captureFile, ", ", bytesWritten, " bytes");
+    DEBUG_LOG("Capture frames dropped: ", framesDropped);
+}
@@ -10,33 +10,3 @@
 #include "maths.hh"
 
 const Color Color::transparent = Color(0);
-
-Color operator+(const Color &lhs, const Color &rhs)
-{
-    return Color(lhs.getR() + rhs.getR(),
-                lhs.getG() + rhs.getG(),
-                lhs.getB() + rhs.getB());
-}
-
-Color operator-(const Color &lhs, const Color &rhs)
-{
-    return Color(lhs.getR() - rhs.getR(),
-                lhs.getG() - rhs.getG(),
-                lhs.getB() - rhs.getB());
-}
-
-Color& Color::operator+=(const Color &rhs)
-{
-    setR(getR() + rhs.getR());
-    setG(getG() + rhs.getG());
-    setB(getB() + rhs.getB());
-    return *this;
-}
-
-Color& Color::operator-=(const Color &rhs)
-{
-    setR(getR() - rhs.getR());
-    setG(getG() - rhs.getG());
-    setB(getB() - rhs.getB());
-    return *this;
-}
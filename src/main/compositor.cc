@@ -0,0 +1,304 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// compositor.cc: drawing stage layers
+
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+#include "compositor.hh"
+#include "overdraw.hh"
+#include "tiled.hh"
+
+// tilemap layers have always truncated their scroll, the others round it
+static inline int scrollOffset(const BackgroundLayer &layer, Fix offset)
+{
+    return layer.strip() ? static_cast<int>(offset) : offset.round();
+}
+
+// the placements of the kinds of tiling
+template <LayerTiling tiling>
+static void placeLayer(const BackgroundLayer &layer, LayerScroll scroll,
+                LayerPlacement &place)
+{
+    const LayerDescriptor &desc = layer.descriptor();
+    const Image &img = layer.image();
+    int sy = scrollOffset(layer, scroll.y * desc.scrollYMul);
+    place.scroll = scroll;
+    place.sx = scrollOffset(layer, scroll.x * desc.scrollXMul) - desc.offsetX;
+    place.wrap = tiling != LayerTiling::None;
+    place.opaque = true;
+    if constexpr (tiling == LayerTiling::Both)
+    {
+        place.y0 = 0;
+        place.y1 = S_HEIGHT;
+        place.sy = sy - desc.offsetY;
+    }
+    else if constexpr (tiling == LayerTiling::None)
+    {
+        // negative image rows move the layer down instead
+        sy -= desc.offsetY;
+        place.y0 = std::max(0, -sy);
+        place.sy = sy + place.y0;
+        place.y1 = place.y0 + std::min(S_HEIGHT, img.height() - place.sy);
+        place.opaque = place.sx >= 0 && place.sx + S_WIDTH <= img.width();
+    }
+    else if constexpr (tiling == LayerTiling::Horizontal)
+    {
+        // drawn from the top row of the image
+        int dy = desc.offsetY - sy;
+        place.y0 = dy;
+        place.y1 = dy + std::min(S_HEIGHT + std::min(dy, 0), img.height());
+        place.sy = 0;
+    }
+    else
+    {
+        int oy = sy - desc.offsetY;
+        place.y0 = std::max(0, -oy);
+        place.y1 = std::min(S_HEIGHT, img.height());
+        place.sy = std::max(0, oy);
+    }
+}
+
+// one source row for each screen row from y, for count rows starting
+// from image row sy
+template <LayerRowEffect effect>
+static void rasterLines(const BackgroundLayer &layer,
+                const LayerPlacement &place, int sy, int count,
+                RasterLine *lines)
+{
+    const LayerDescriptor &desc = layer.descriptor();
+    Fix x = place.scroll.x;
+    if constexpr (effect == LayerRowEffect::Parallax)
+    {
+        // the scroll speed changes with every image row
+        Fix step = (desc.reverse ? -1 : 1) * 0.016_x;
+        Fix xm = desc.scrollXMul + step * sy;
+        for (int i = 0; i < count; ++i, xm += step)
+            lines[i] = { (x * xm).round() - desc.offsetX, sy + i };
+    }
+    else if constexpr (effect == LayerRowEffect::Wave)
+    {
+        int sinOff = (layer.phase() + sy) % 256;
+        Fix sx = x * desc.scrollXMul;
+        for (int i = 0; i < count; ++i, sinOff = (sinOff + 1) % 256)
+            lines[i] = { (sx + 16 * sineTable[sinOff >> 1]).round()
+                            - desc.offsetX, sy + i };
+    }
+}
+
+// raster blits only replace pixels
+template <LayerTiling tiling, LayerBlend blend, LayerRowEffect effect>
+constexpr bool isDrawable()
+{
+    return effect == LayerRowEffect::None || blend == LayerBlend::Normal;
+}
+
+template <LayerTiling tiling, LayerBlend blend, LayerRowEffect effect>
+static void drawLayer(const BackgroundLayer &layer, Image &fb,
+                const LayerPlacement &place, int y0, int y1)
+{
+    constexpr bool tiled = tiling != LayerTiling::None;
+    int sy = place.sy;
+    if (place.y0 > y0)
+        y0 = place.y0;
+    else
+        sy += y0 - place.y0;
+    y1 = std::min(y1, place.y1);
+    if (y0 >= y1)
+        return;
+    Image &img = layer.image();
+    int sh = y1 - y0;
+    if constexpr (effect != LayerRowEffect::None)
+    {
+        std::array<RasterLine, S_HEIGHT> lines;
+        rasterLines<effect>(layer, place, sy, sh, lines.data());
+        if constexpr (tiled)
+            img.blitRasterTiled(fb, 0, y0, S_WIDTH, lines.data(), sh);
+        else
+            img.blitRaster(fb, 0, y0, S_WIDTH, lines.data(), sh);
+    }
+    else if constexpr (blend == LayerBlend::Additive)
+    {
+        if constexpr (tiled)
+            img.blitAdditiveTiled(fb, 0, y0, place.sx, sy, S_WIDTH, sh);
+        else
+            img.blitAdditive(fb, 0, y0, place.sx, sy, S_WIDTH, sh);
+    }
+    else
+    {
+        if constexpr (tiled)
+            img.blitTiled(fb, 0, y0, place.sx, sy, S_WIDTH, sh);
+        else
+            img.blit(fb, 0, y0, place.sx, sy, S_WIDTH, sh);
+    }
+}
+
+// the descriptor is only looked at here; a new kind of layer only needs
+// its cases added, and costs nothing per frame
+template <LayerTiling tiling, LayerBlend blend>
+static LayerCompositor::DrawFunction selectDraw(LayerRowEffect effect)
+{
+    switch (effect)
+    {
+    case LayerRowEffect::None:
+        return &drawLayer<tiling, blend, LayerRowEffect::None>;
+    case LayerRowEffect::Parallax:
+        if constexpr (isDrawable<tiling, blend, LayerRowEffect::Parallax>())
+            return &drawLayer<tiling, blend, LayerRowEffect::Parallax>;
+        break;
+    case LayerRowEffect::Wave:
+        if constexpr (isDrawable<tiling, blend, LayerRowEffect::Wave>())
+            return &drawLayer<tiling, blend, LayerRowEffect::Wave>;
+        break;
+    }
+    return nullptr;
+}
+
+template <LayerTiling tiling>
+static LayerCompositor::DrawFunction selectDraw(const LayerDescriptor &desc)
+{
+    switch (desc.blend)
+    {
+    case LayerBlend::Normal:
+        return selectDraw<tiling, LayerBlend::Normal>(desc.rowEffect);
+    case LayerBlend::Additive:
+        return selectDraw<tiling, LayerBlend::Additive>(desc.rowEffect);
+    }
+    return nullptr;
+}
+
+static void selectFunctions(const LayerDescriptor &desc,
+                LayerCompositor::PlaceFunction &place,
+                LayerCompositor::DrawFunction &draw)
+{
+    switch (desc.tiling)
+    {
+    case LayerTiling::Both:
+        place = &placeLayer<LayerTiling::Both>;
+        draw = selectDraw<LayerTiling::Both>(desc);
+        break;
+    case LayerTiling::None:
+        place = &placeLayer<LayerTiling::None>;
+        draw = selectDraw<LayerTiling::None>(desc);
+        break;
+    case LayerTiling::Horizontal:
+        place = &placeLayer<LayerTiling::Horizontal>;
+        draw = selectDraw<LayerTiling::Horizontal>(desc);
+        break;
+    case LayerTiling::HorizontalWrapped:
+        place = &placeLayer<LayerTiling::HorizontalWrapped>;
+        draw = selectDraw<LayerTiling::HorizontalWrapped>(desc);
+        break;
+    default:
+        place = nullptr;
+        draw = nullptr;
+    }
+    if (!place || !draw)
+        throw std::runtime_error("Unsupported kind of layer");
+}
+
+void LayerCompositor::build(const std::vector<BackgroundLayer *> &layers,
+                const char *name, bool culled)
+{
+    _program.clear();
+    for (BackgroundLayer *layer : layers)
+    {
+        Step step{layer, nullptr, nullptr};
+        selectFunctions(layer->descriptor(), step.place, step.draw);
+        _program.push_back(step);
+    }
+    _placements.resize(_program.size());
+    _rows.resize(culled ? _program.size() : 0);
+    _name = name;
+    _culled = culled;
+}
+
+void LayerCompositor::classifyRows(const BackgroundLayer &layer,
+                const LayerPlacement &place, LayerRows &rows)
+{
+    rows.fill(RowOpacity::Transparent);
+    int y0 = std::max(place.y0, 0), y1 = std::min(place.y1, S_HEIGHT);
+    int sy = place.sy + (y0 - place.y0), h = layer.image().height();
+    bool opaque = place.opaque
+            && layer.descriptor().blend == LayerBlend::Normal;
+    const std::vector<RowOpacity> &opacity = layer.rowOpacity();
+    RowOpacity row;
+    for (int y = y0; y < y1; ++y, ++sy)
+    {
+        if (opacity.empty())
+            row = RowOpacity::Mixed;
+        else
+            row = opacity[place.wrap ? remainder(sy, h) : sy];
+        if (row == RowOpacity::Opaque && !opaque)
+            row = RowOpacity::Mixed;
+        rows[y] = row;
+    }
+}
+
+void LayerCompositor::draw(Image &fb, LayerScroll scroll)
+{
+    int height = std::min(fb.height(), S_HEIGHT);
+    std::size_t count = _program.size();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const Step &step = _program[i];
+        if (!step.layer->shown())
+            continue;
+        if (TileStrip *strip = step.layer->strip())
+            strip->scrollTo(static_cast<int>(scroll.x
+                    * step.layer->descriptor().scrollXMul));
+        step.place(*step.layer, scroll, _placements[i]);
+    }
+
+    if (_culled)
+    {
+        // from the top down, so that each layer knows what is above it
+        std::array<bool, S_HEIGHT> covered{};
+        ProfileLayer("culling");
+        for (std::size_t i = count; i-- > 0; )
+        {
+            if (!_program[i].layer->shown())
+                continue;
+            LayerRows &rows = _rows[i];
+            classifyRows(*_program[i].layer, _placements[i], rows);
+            for (int y = 0; y < height; ++y)
+            {
+                if (covered[y])
+                    rows[y] = RowOpacity::Transparent;
+                else if (rows[y] == RowOpacity::Opaque)
+                    covered[y] = true;
+            }
+        }
+    }
+
+    int y, y0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const Step &step = _program[i];
+        BackgroundLayer &layer = *step.layer;
+        if (!layer.shown())
+            continue;
+        ProfileLayer(_name, i);
+        if (!_culled)
+            step.draw(layer, fb, _placements[i], 0, height);
+        else
+        {
+            const LayerRows &rows = _rows[i];
+            y = 0;
+            while (y < height)
+            {
+                if (rows[y++] == RowOpacity::Transparent)
+                    continue;
+                y0 = y - 1;
+                while (y < height && rows[y] != RowOpacity::Transparent)
+                    ++y;
+                step.draw(layer, fb, _placements[i], y0, y);
+            }
+        }
+        layer.advance();
+    }
+}
@@ -7,16 +7,32 @@
 // config.cc: code for options
 
 #include <fstream>
+#include <algorithm>
 #include "config.hh"
 #include "cfg.hh"
 #include "defs.hh"
 #include "malpinx.hh"
 #include "input.hh"
+#include "overdraw.hh"
+#include "capture.hh"
+#include "fbexport.hh"
 
 static ConfigFile cfg;
 constexpr char configFileName[] = "malpinx.cfg";
 bool highQualityAudio;
 int startContinues;
+bool pipelinedRendering;
+bool interpolateFrames;
+int maxFrameSkip;
+
+// get would add the key to the file with its default value; the rendering
+// and debugging keys are only ever set by hand, so leave them out unless
+// they were there already
+template <typename T>
+static T GetIfPresent(const std::string &key, T fallback)
+{
+    return cfg.has(key) ? cfg.get(key, fallback) : fallback;
+}
 
 static void LoadConfigInternal()
 {
@@ -30,6 +46,13 @@ static void LoadConfigInternal()
     if (static_cast<int>(pmode) > maxPlaybackMode)
         pmode = PlaybackMode::NORMAL;
     startContinues = cfg.get("Continues", 3);
+    pipelinedRendering = GetIfPresent("PipelinedRendering", false);
+    interpolateFrames = GetIfPresent("InterpolateFrames", false);
+    maxFrameSkip = std::max(GetIfPresent("MaxFrameSkip", 0), 0);
+    profileLayers = GetIfPresent("ProfileLayers", false);
+    overdrawHeatMap = GetIfPresent("OverdrawHeatMap", false);
+    captureFile = GetIfPresent("CaptureFile", std::string());
+    sharedFramebuffer = GetIfPresent("SharedFramebuffer", std::string());
     ReadInputControls(cfg);
 }
 
@@ -46,6 +69,7 @@ void LoadConfig()
 void ApplySettingsToBackend()
 {
     backend->scale(cfg.get("Scale", 1));
+    backend->filter(GetUpscaleFilter(cfg.get("Filter", std::string("none"))));
 }
 
 static void SaveConfigToFile()
@@ -67,11 +91,13 @@ void SaveConfig()
 {
     cfg.set("HQAudio", highQualityAudio);
     cfg.set("Scale", backend->scale());
+    cfg.set("Filter", std::string(GetUpscaleFilterName(backend->filter())));
     cfg.set("Difficulty", static_cast<int>(difficulty));
     cfg.set("Mode", static_cast<int>(pmode));
     cfg.set("Music", musicEnabled);
     cfg.set("SoundEffects", sfxEnabled);
     cfg.set("Continues", startContinues);
+    // the rendering and debugging keys are kept as they were in the file
     SaveInputControls(cfg);
     SaveConfigToFile();
 }
@@ -7,10 +7,106 @@
 // enemy.cc: base enemy code
 
 #include <stdexcept>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <iterator>
 #include "enemy.hh"
 #include "bullet.hh"
 
-static Image flashBuffer{S_WIDTH * 2, S_HEIGHT * 2};
+// which tint of which frame
+struct FlashKey
+{
+    const Image *source;
+    int flash;
+    bool redShift;
+
+    bool operator==(const FlashKey &other) const
+    {
+        return source == other.source && flash == other.flash
+            && redShift == other.redShift;
+    }
+};
+
+struct FlashKeyHash
+{
+    std::size_t operator()(const FlashKey &key) const
+    {
+        return std::hash<const Image *>()(key.source)
+            ^ (static_cast<std::size_t>(key.flash) << 1 | key.redShift);
+    }
+};
+
+// tinted copy of an enemy frame
+struct FlashVariant
+{
+    FlashKey key;
+    std::weak_ptr<Image> source;
+    std::shared_ptr<Image> image;
+};
+
+// upper bound for the total size of all cached variants
+constexpr std::size_t FLASH_CACHE_MAX_PIXELS = 512 * 1024;
+
+// the variants from the most recently used to the least, and where each
+// one is in that list
+static std::list<FlashVariant> flashCache;
+static std::unordered_map<FlashKey, std::list<FlashVariant>::iterator,
+                          FlashKeyHash> flashCacheIndex;
+static std::size_t flashCachePixels = 0;
+
+static void dropFlashVariant(std::list<FlashVariant>::iterator variant)
+{
+    flashCachePixels -= variant->image->width() * variant->image->height();
+    flashCacheIndex.erase(variant->key);
+    flashCache.erase(variant);
+}
+
+static Image &getFlashVariant(const std::shared_ptr<Image> &img,
+                                    int flash, bool redShift)
+{
+    FlashKey key{ img.get(), flash, redShift };
+    auto found = flashCacheIndex.find(key);
+    if (found != flashCacheIndex.end())
+    {
+        auto variant = found->second;
+        // an expired source may have been replaced by another image
+        // at the same address, so compare owners rather than pointers
+        if (!variant->source.owner_before(img)
+                && !img.owner_before(variant->source)
+                && !variant->source.expired())
+        {
+            flashCache.splice(flashCache.begin(), flashCache, variant);
+            return *variant->image;
+        }
+        dropFlashVariant(variant);
+    }
+
+    int w = img->width(), h = img->height();
+    auto image = std::make_shared<Image>(w, h);
+    img->blitFast(*image, 0, 0, 0, 0, w, h);
+    image->addSolid(Color(flash, flash, flash));
+    if (redShift)
+        image->subtractSolid(Color(0, S_MAXCLR, S_MAXCLR));
+    image->buildSpans();
+
+    std::size_t size = w * h;
+    while (!flashCache.empty()
+            && flashCachePixels + size > FLASH_CACHE_MAX_PIXELS)
+        dropFlashVariant(std::prev(flashCache.end()));
+    flashCachePixels += size;
+    flashCache.push_front({ key, img, image });
+    flashCacheIndex.emplace(key, flashCache.begin());
+    return *image;
+}
+
+void ClearEnemyFlashCache()
+{
+    flashCache.clear();
+    flashCacheIndex.clear();
+    flashCachePixels = 0;
+}
 
 void EnemySprite::blit(Image &fb, int xoff, int yoff) const
 {
@@ -19,14 +115,8 @@ void EnemySprite::blit(Image &fb, int xoff, int yoff) const
         Sprite::blit(fb, xoff, yoff);
         return;
     }
-    int w = _img->width(), h = _img->height();
-    int ox = _x.round() + xoff, oy = _y.round() + yoff,
-        tx = ox + S_WIDTH, ty = oy + S_HEIGHT;
-    _img->blitFast(flashBuffer, tx, ty, 0, 0, w, h);
-    flashBuffer.addSolid(Color(_flash, _flash, _flash), tx, ty, w, h);
-    if (_redShift)
-        flashBuffer.subtractSolid(Color(0, S_MAXCLR, S_MAXCLR), tx, ty, w, h);
-    flashBuffer.blit(fb, ox, oy, tx, ty, w, h);
+    getFlashVariant(_img, _flash, _redShift).blit(fb,
+            drawX().round() + xoff, drawY().round() + yoff);
 };
 
 EnemySprite::EnemySprite(Shooter &stg, int id, Fix x, Fix y,
@@ -27,6 +27,8 @@ ExplosionSprite::ExplosionSprite(Shooter &stg, int id, Fix x, Fix y,
     {
         _x -= _img->width() / 2;
         _y -= _img->height() / 2;
+        // so that frames between ticks do not show it moving there
+        savePosition();
     }
 }
 
@@ -0,0 +1,137 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// fbexport.cc: publishing the shown frames in shared memory
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include "fbexport.hh"
+#include "render.hh"
+#include "blit.hh"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define M_FBEXPORT_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+std::string sharedFramebuffer;
+
+// as described in fbexport.hh
+struct SharedFrame
+{
+    char magic[8];
+    std::uint16_t width;
+    std::uint16_t height;
+    std::atomic<std::uint32_t> sequence;
+    std::uint64_t frame;
+    std::uint64_t timestamp;
+    std::uint8_t reserved[32];
+    Color pixels[S_WIDTH * S_HEIGHT];
+};
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free,
+                "the sequence number must be usable from other processes");
+static_assert(offsetof(SharedFrame, sequence) == 12
+            && offsetof(SharedFrame, timestamp) == 24
+            && offsetof(SharedFrame, pixels) == 64,
+                "the layout of SharedFrame must match fbexport.hh");
+
+static const char sharedFrameMagic[8] = { 'M','P','X','S','H','F','B','1' };
+static SharedFrame *shared = nullptr;
+static std::string sharedName;
+// the pixels are only copied for a frame that differs from the last one
+static bool sharedValid;
+
+#if M_FBEXPORT_POSIX
+void StartFramebufferExport()
+{
+    if (sharedFramebuffer.empty() || shared)
+        return;
+    // the name of a portable shared memory object starts with a slash
+    sharedName = sharedFramebuffer[0] == '/' ? sharedFramebuffer
+                                             : "/" + sharedFramebuffer;
+    int fd = shm_open(sharedName.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        DEBUG_LOG("Cannot open shared memory ", sharedName);
+        return;
+    }
+    void *map = MAP_FAILED;
+    if (!ftruncate(fd, sizeof(SharedFrame)))
+        map = mmap(nullptr, sizeof(SharedFrame), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        DEBUG_LOG("Cannot map shared memory ", sharedName);
+        shm_unlink(sharedName.c_str());
+        return;
+    }
+    // the pixels start out transparent
+    shared = new (map) SharedFrame;
+    shared->width = S_WIDTH;
+    shared->height = S_HEIGHT;
+    shared->frame = 0;
+    shared->timestamp = 0;
+    shared->sequence.store(0, std::memory_order_relaxed);
+    // readers only look at an object with the magic in place
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(shared->magic, sharedFrameMagic, sizeof(sharedFrameMagic));
+    sharedValid = false;
+    DEBUG_LOG("Exporting frames to shared memory ", sharedName);
+}
+
+void StopFramebufferExport()
+{
+    if (!shared)
+        return;
+    // readers that have it mapped keep the last frame
+    munmap(shared, sizeof(SharedFrame));
+    shm_unlink(sharedName.c_str());
+    shared = nullptr;
+}
+#else
+void StartFramebufferExport()
+{
+    if (!sharedFramebuffer.empty())
+        DEBUG_LOG("Shared memory frame export is not supported here");
+}
+
+void StopFramebufferExport()
+{
+}
+#endif
+
+// a seqlock: the sequence number is odd while the frame is written
+void ExportFrame(bool changed)
+{
+    if (!shared)
+        return;
+    std::uint32_t sequence = shared->sequence.load(std::memory_order_relaxed);
+    shared->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (changed || !sharedValid)
+    {
+        int fade = GetFadeLevel();
+        if (fade)
+            ColorRowCopySubtract(shared->pixels, fb_back.pixels(),
+                        S_WIDTH * S_HEIGHT, Color(fade, fade, fade));
+        else
+            std::memcpy(shared->pixels, fb_back.pixels(),
+                        sizeof(shared->pixels));
+        sharedValid = true;
+    }
+    ++shared->frame;
+    shared->timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    shared->sequence.store(sequence + 2, std::memory_order_release);
+}
@@ -7,43 +7,140 @@
 // image.cc: class for images and image rendering
 
 #include <vector>
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include "defs.hh"
 #include "image.hh"
 #include "maths.hh"
+#include "blit.hh"
+#include "binrender.hh"
+#include "overdraw.hh"
 #include <iostream>
 
 Image::Image(int width, int height)
-    : _width(width), _height(height), _data(width * height)
+    : _width(width), _height(height), _data(width * height),
+      _offset(0), _stride(width)
 {
 }
 
 Image::Image(int width, int height, std::vector<Color> &&data)
-    : _width(width), _height(height), _data(data)
+    : _width(width), _height(height), _data(data),
+      _offset(0), _stride(width)
 {
     if (_data.size() != _width * _height)
         throw std::runtime_error("invalid image data size");
 }
 
+Image::Image(std::shared_ptr<const std::vector<Color>> atlas,
+            std::size_t offset, int width, int height, int stride)
+    : _width(width), _height(height), _atlas(atlas),
+      _offset(offset), _stride(stride)
+{
+    if (stride < width || offset + stride * height > _atlas->size())
+        throw std::runtime_error("invalid image view");
+}
+
+void Image::detach()
+{
+    if (!_atlas) return;
+    std::vector<Color> data(_width * _height);
+    const Color *src = pixels();
+    for (int y = 0; y < _height; ++y)
+        std::copy(src + y * _stride, src + y * _stride + _width,
+                  data.begin() + y * _width);
+    _data = std::move(data);
+    _atlas = nullptr;
+    _offset = 0;
+    _stride = _width;
+    _snapshot = nullptr;
+}
+
+std::shared_ptr<Image> Image::snapshot()
+{
+    if (!_snapshot)
+    {
+        // turn into a view of our own pixels, so that the next write
+        // copies them first
+        if (!_atlas)
+        {
+            _atlas = std::make_shared<const std::vector<Color>>(
+                        std::move(_data));
+            _data = std::vector<Color>();
+        }
+        _snapshot = std::make_shared<Image>(_atlas, _offset,
+                        _width, _height, _stride);
+        _snapshot->_spanRows = _spanRows;
+        _snapshot->_spans = _spans;
+    }
+    return _snapshot;
+}
+
 void Image::clear()
 {
+    if (_recorder)
+        return _recorder->addColor(DrawOp::Clear, Color::transparent,
+                0, 0, _width, _height);
+    if (_overdraw)
+        _overdraw->countRect(0, 0, _width, _height);
+    detach();
+    dropSpans();
     std::fill(_data.begin(), _data.end(), Color::transparent);
 }
 
 void Image::fill(Color color)
 {
+    detach();
+    dropSpans();
     std::fill(_data.begin(), _data.end(), color);
 }
 
-constexpr static std::uint16_t maskTable[] = { 0xffff, 0x0000 };
+void Image::buildSpans()
+{
+    dropSpans();
+    _spanRows.reserve(_height + 1);
+    const Color *row = pixels();
+    int x, start;
+    for (int y = 0; y < _height; ++y)
+    {
+        _spanRows.push_back(_spans.size());
+        x = 0;
+        while (x < _width)
+        {
+            while (x < _width && !row[x])
+                ++x;
+            start = x;
+            while (x < _width && row[x])
+                ++x;
+            if (x > start)
+                _spans.push_back({ static_cast<std::uint16_t>(start),
+                                   static_cast<std::uint16_t>(x - start) });
+        }
+        row += _stride;
+    }
+    _spanRows.push_back(_spans.size());
+}
 
-template <bool tiled, bool fast, bool additive>
-static inline REALLY_INLINE void doBlit(Image &fb,
-                int mw, int mh, std::vector<Color> &_data,
-                int dx, int dy, int sx, int sy, int sw, int sh)
+std::vector<RowOpacity> Image::rowOpacity() const
 {
-    static_assert(!(tiled && fast), "cannot use tiling with fast blit");
+    std::vector<RowOpacity> rows(_height);
+    const Color *row = pixels();
+    for (int y = 0; y < _height; ++y, row += _stride)
+    {
+        int opaque = std::count_if(row, row + _width,
+                        [](Color c) { return !c.isTransparent(); });
+        rows[y] = !opaque ? RowOpacity::Transparent
+                : opaque == _width ? RowOpacity::Opaque
+                : RowOpacity::Mixed;
+    }
+    return rows;
+}
 
+// clips the blit rectangle; returns false if there is nothing to draw
+template <bool tiled>
+static inline REALLY_INLINE bool clipBlit(const Image &fb, int mw, int mh,
+                int &dx, int &dy, int &sx, int &sy, int &sw, int &sh)
+{
     if constexpr (!tiled)
     {
         if (sx < 0)
@@ -71,7 +168,7 @@ static inline REALLY_INLINE void doBlit(Image &fb,
         sh += dy;
         dy = 0;
     }
-    if (sw <= 0 || sh <= 0) return;
+    if (sw <= 0 || sh <= 0) return false;
 
     int fbs = fb.width(), fbh = fb.height();
     if constexpr (tiled)
@@ -84,128 +181,404 @@ static inline REALLY_INLINE void doBlit(Image &fb,
         sw = std::min({ sw, mw - sx, fbs - dx });
         sh = std::min({ sh, mh - sy, fbh - dy });
     }
-    if (sw <= 0 || sh <= 0) return;
+    return sw > 0 && sh > 0;
+}
 
-    int xo, yo, stripe_off = fbs - sw;
+// modulated blits darken each source pixel by shade
+template <bool tiled, bool fast, bool additive, bool modulated = false>
+static inline REALLY_INLINE void doBlit(Image &fb,
+                int mw, int mh, const Color *data, int ms,
+                int dx, int dy, int sx, int sy, int sw, int sh,
+                Color shade = Color())
+{
+    static_assert(!(tiled && fast), "cannot use tiling with fast blit");
+    static_assert(!(tiled && modulated), "cannot use tiling with shading");
+    if (!clipBlit<tiled>(fb, mw, mh, dx, dy, sx, sy, sw, sh))
+        return;
+
+    int fbs = fb.width();
+    int xo, yo, n;
     auto dst = fb.buffer().begin() + (dy * fbs + dx);
-    int osrcx = remainder(sx, mw), srcx = osrcx, srcy = remainder(sy, mh);
-    auto src = _data.begin() + (srcy * mw + srcx);
-    int gap = mw - (sx + sw);
-    auto row_end = src, til_nxt = src;
-    auto img_end = _data.end();
-    int mask;
+    int osrcx = remainder(sx, mw), srcx, srcy = remainder(sy, mh);
+    const Color *src = data + (srcy * ms + osrcx);
+    const Color *row_end, *line;
     for (yo = 0; yo < sh; ++yo)
     {
-        row_end = src + sw, til_nxt = src + mw;
-        srcx = osrcx;
+        row_end = src + sw;
         if constexpr (fast)
         {
-            if constexpr (additive)
-                std::transform(src, row_end, dst, dst,
-                    [](const Color &a, const Color &b) { return a + b; });
+            if constexpr (additive && modulated)
+                BlitRowAdditiveModulated(&*dst, src, sw, shade);
+            else if constexpr (additive)
+                BlitRowAdditive(&*dst, src, sw);
+            else if constexpr (modulated)
+                ColorRowCopySubtract(&*dst, src, sw, shade);
             else
                 std::copy(src, row_end, dst);
-            src += mw;
+            src += ms;
+            dst += fbs;
+        }
+        else if constexpr (!tiled && !additive)
+        {
+            if constexpr (modulated)
+                BlitRowModulated(&*dst, src, sw, shade);
+            else
+                BlitRowTransparent(&*dst, src, sw);
+            src += ms;
             dst += fbs;
         }
         else
         {
-            for (xo = 0; xo < sw; ++xo, ++src, ++dst)
+            // the row is drawn in pieces that end at the right image edge,
+            // so that no pixel has to check whether it wraps around
+            line = data + srcy * ms;
+            for (xo = 0, srcx = osrcx; xo < sw; xo += n, srcx = 0)
             {
+                n = std::min(sw - xo, mw - srcx);
                 if constexpr (additive)
-                {
-                    *dst += *src;
-                }
+                    BlitRowAdditiveKeep(&*dst + xo, line + srcx, n);
                 else
-                {
-                    mask = maskTable[(*src).isTransparent()];
-                    *dst = ((*dst).v & ~mask) | ((*src).v & mask);
-                }
-                //if (!(*src).isTransparent())
-                //    *dst = *src;
-                if constexpr (tiled)
-                {
-                    if (++srcx == mw)
-                    {
-                        src -= mw;
-                        srcx -= mw;
-                    }
-                }
+                    BlitRowTransparent(&*dst + xo, line + srcx, n);
             }
-            dst += stripe_off;
-            src = til_nxt;
-            if constexpr (tiled)
+            dst += fbs;
+            if (++srcy == mh)
+                srcy = 0;
+        }
+    }
+}
+
+// copies only the opaque runs of each row; row copies each clipped run
+template <class RowOp>
+static inline void doBlitSpans(Image &fb, int mw, int mh,
+                const Color *data, int ms,
+                const std::vector<int> &rows,
+                const std::vector<ImageSpan> &spans,
+                int dx, int dy, int sx, int sy, int sw, int sh, RowOp row)
+{
+    if (!clipBlit<false>(fb, mw, mh, dx, dy, sx, sy, sw, sh))
+        return;
+
+    int fbs = fb.width(), sx_end = sx + sw;
+    int x0, x1;
+    Color *dst = fb.buffer().data() + (dy * fbs + dx);
+    const Color *src = data + sy * ms;
+    std::vector<ImageSpan>::const_iterator span, row_end;
+    for (int srcy = sy; srcy < sy + sh; ++srcy)
+    {
+        row_end = spans.begin() + rows[srcy + 1];
+        for (span = spans.begin() + rows[srcy]; span != row_end; ++span)
+        {
+            if (span->offset >= sx_end)
+                break;
+            x0 = std::max<int>(span->offset, sx);
+            x1 = std::min<int>(span->offset + span->length, sx_end);
+            if (x0 < x1)
+                row(dst + (x0 - sx), src + x0, x1 - x0);
+        }
+        src += ms;
+        dst += fbs;
+    }
+}
+
+// blits one source row per destination row, clipping each row; row
+// combines the pixels of each clipped piece
+template <bool tiled, class RowOp>
+static inline void doBlitRaster(Image &fb, int mw, int mh,
+                const Color *data, int ms, int dx, int dy, int sw,
+                const RasterLine *lines, int count, RowOp row)
+{
+    int fbs = fb.width(), fbh = fb.height();
+    int y0 = std::max(0, -dy), y1 = std::min(count, fbh - dy);
+    int x, sx, sy, w, n;
+    Color *fbd = fb.buffer().data(), *dst;
+    const Color *src;
+    for (int i = y0; i < y1; ++i)
+    {
+        x = dx, sx = lines[i].sx, sy = lines[i].sy, w = sw;
+        if constexpr (tiled)
+            sy = remainder(sy, mh);
+        else
+        {
+            if (sy < 0 || sy >= mh)
+                continue;
+            if (sx < 0)
             {
-                if (++srcy == mh)
-                {
-                    src -= _data.size();
-                    srcy -= mh;
-                }
+                x -= sx;
+                sx = 0;
+            }
+        }
+        if (x < 0)
+        {
+            sx -= x;
+            w += x;
+            x = 0;
+        }
+        if constexpr (tiled)
+            w = std::min(w, fbs - x);
+        else
+            w = std::min({ w, mw - sx, fbs - x });
+        if (w <= 0)
+            continue;
+
+        dst = fbd + ((dy + i) * fbs + x);
+        src = data + sy * ms;
+        if constexpr (tiled)
+        {
+            // draw the row in pieces that end at the right image edge
+            for (sx = remainder(sx, mw); w > 0; sx = 0)
+            {
+                n = std::min(w, mw - sx);
+                row(dst, src + sx, n);
+                dst += n;
+                w -= n;
             }
         }
+        else
+            row(dst, src + sx, w);
+    }
+}
+
+// counts the pixels a blit writes in the overdraw map of fb; transparent
+// source pixels are only written by fast and additive blits
+template <bool tiled>
+static void countBlit(Image &fb, int mw, int mh, const Color *data, int ms,
+                bool all, int dx, int dy, int sx, int sy, int sw, int sh)
+{
+    if (!clipBlit<tiled>(fb, mw, mh, dx, dy, sx, sy, sw, sh))
+        return;
+    OverdrawMap &map = *fb.overdraw();
+    int srcx, srcy = remainder(sy, mh), x, n;
+    const Color *src;
+    for (int yo = 0; yo < sh; ++yo)
+    {
+        src = data + srcy * ms;
+        // tiled rows are counted in pieces that end at the right image edge
+        for (x = 0, srcx = remainder(sx, mw); x < sw; x += n, srcx = 0)
+        {
+            n = std::min(sw - x, mw - srcx);
+            map.countRow(dx + x, dy + yo, all ? nullptr : src + srcx, n);
+        }
+        if (++srcy == mh)
+            srcy = 0;
     }
 }
 
+template <bool tiled>
+static void countBlitRaster(Image &fb, int mw, int mh,
+                const Color *data, int ms, int dx, int dy, int sw,
+                const RasterLine *lines, int count)
+{
+    OverdrawMap &map = *fb.overdraw();
+    const Color *base = fb.buffer().data();
+    int fbs = fb.width();
+    doBlitRaster<tiled>(fb, mw, mh, data, ms, dx, dy, sw, lines, count,
+        [&](Color *dst, const Color *src, int n)
+        {
+            int i = dst - base;
+            map.countRow(i % fbs, i / fbs, src, n);
+        });
+}
+
+// records the blit instead if fb is being recorded
+static inline bool deferBlit(Image &fb, DrawOp op, Image *src,
+                int dx, int dy, int sx, int sy, int sw, int sh,
+                Color shade = Color())
+{
+    if (!fb.recorder())
+        return false;
+    fb.recorder()->add(op, src, dx, dy, sx, sy, sw, sh, shade);
+    return true;
+}
+
+static inline void copyRow(Color *dst, const Color *src, int n)
+{
+    std::memcpy(dst, src, n * sizeof(Color));
+}
+
+void Image::blitRaster(Image &fb, int dx, int dy, int sw,
+                const RasterLine *lines, int count)
+{
+    if (fb.recorder())
+        return fb.recorder()->addRaster(DrawOp::BlitRaster, this,
+                dx, dy, sw, lines, count);
+    if (fb.overdraw())
+        countBlitRaster<false>(fb, _width, _height, pixels(), _stride,
+                dx, dy, sw, lines, count);
+    doBlitRaster<false>(fb, _width, _height, pixels(), _stride,
+            dx, dy, sw, lines, count, BlitRowTransparent);
+}
+
+void Image::blitRasterTiled(Image &fb, int dx, int dy, int sw,
+                const RasterLine *lines, int count)
+{
+    if (fb.recorder())
+        return fb.recorder()->addRaster(DrawOp::BlitRasterTiled, this,
+                dx, dy, sw, lines, count);
+    if (fb.overdraw())
+        countBlitRaster<true>(fb, _width, _height, pixels(), _stride,
+                dx, dy, sw, lines, count);
+    doBlitRaster<true>(fb, _width, _height, pixels(), _stride,
+            dx, dy, sw, lines, count, BlitRowTransparent);
+}
+
 void Image::blit(Image &fb, int dx, int dy,
                 int sx, int sy, int sw, int sh)
 {
-    doBlit<false, false, false>(fb, _width, _height, _data,
-            dx, dy, sx, sy, sw, sh);   
+    if (deferBlit(fb, DrawOp::Blit, this, dx, dy, sx, sy, sw, sh))
+        return;
+    if (fb.overdraw())
+        countBlit<false>(fb, _width, _height, pixels(), _stride, false,
+                dx, dy, sx, sy, sw, sh);
+    if (hasSpans() && &fb != this)
+        doBlitSpans(fb, _width, _height, pixels(), _stride,
+                _spanRows, _spans, dx, dy, sx, sy, sw, sh, copyRow);
+    else
+        doBlit<false, false, false>(fb, _width, _height, pixels(), _stride,
+                dx, dy, sx, sy, sw, sh);
 }
 
 void Image::blitTiled(Image &fb, int dx, int dy,
                 int sx, int sy, int sw, int sh)
 {
-    doBlit<true, false, false>(fb, _width, _height, _data,
+    if (deferBlit(fb, DrawOp::BlitTiled, this, dx, dy, sx, sy, sw, sh))
+        return;
+    if (fb.overdraw())
+        countBlit<true>(fb, _width, _height, pixels(), _stride, false,
+                dx, dy, sx, sy, sw, sh);
+    doBlit<true, false, false>(fb, _width, _height, pixels(), _stride,
             dx, dy, sx, sy, sw, sh);
 }
 
 void Image::blitFast(Image &fb, int dx, int dy,
                 int sx, int sy, int sw, int sh)
 {
-    doBlit<false, true, false>(fb, _width, _height, _data,
+    if (deferBlit(fb, DrawOp::BlitFast, this, dx, dy, sx, sy, sw, sh))
+        return;
+    if (fb.overdraw())
+        countBlit<false>(fb, _width, _height, pixels(), _stride, true,
+                dx, dy, sx, sy, sw, sh);
+    doBlit<false, true, false>(fb, _width, _height, pixels(), _stride,
             dx, dy, sx, sy, sw, sh);
 }
 
 void Image::blitAdditive(Image &fb, int dx, int dy,
                 int sx, int sy, int sw, int sh)
 {
-    doBlit<false, true, true>(fb, _width, _height, _data,
+    if (deferBlit(fb, DrawOp::BlitAdditive, this, dx, dy, sx, sy, sw, sh))
+        return;
+    if (fb.overdraw())
+        countBlit<false>(fb, _width, _height, pixels(), _stride, true,
+                dx, dy, sx, sy, sw, sh);
+    doBlit<false, true, true>(fb, _width, _height, pixels(), _stride,
             dx, dy, sx, sy, sw, sh);
 }
 
 void Image::blitAdditiveTiled(Image &fb, int dx, int dy,
                 int sx, int sy, int sw, int sh)
 {
-    doBlit<true, false, true>(fb, _width, _height, _data,
+    if (deferBlit(fb, DrawOp::BlitAdditiveTiled, this, dx, dy, sx, sy, sw, sh))
+        return;
+    if (fb.overdraw())
+        countBlit<true>(fb, _width, _height, pixels(), _stride, true,
+                dx, dy, sx, sy, sw, sh);
+    doBlit<true, false, true>(fb, _width, _height, pixels(), _stride,
             dx, dy, sx, sy, sw, sh);
 }
 
+// a transparent shade would change nothing, so the plain blits are used
+
+void Image::blitModulated(Image &fb, int dx, int dy,
+                int sx, int sy, int sw, int sh, Color shade)
+{
+    if (!shade)
+        return blit(fb, dx, dy, sx, sy, sw, sh);
+    if (deferBlit(fb, DrawOp::BlitModulated, this,
+                dx, dy, sx, sy, sw, sh, shade))
+        return;
+    if (fb.overdraw())
+        countBlit<false>(fb, _width, _height, pixels(), _stride, false,
+                dx, dy, sx, sy, sw, sh);
+    if (hasSpans() && &fb != this)
+        doBlitSpans(fb, _width, _height, pixels(), _stride,
+                _spanRows, _spans, dx, dy, sx, sy, sw, sh,
+                [shade](Color *dst, const Color *src, int n)
+                {
+                    ColorRowCopySubtract(dst, src, n, shade);
+                });
+    else
+        doBlit<false, false, false, true>(fb, _width, _height,
+                pixels(), _stride, dx, dy, sx, sy, sw, sh, shade);
+}
+
+void Image::blitFastModulated(Image &fb, int dx, int dy,
+                int sx, int sy, int sw, int sh, Color shade)
+{
+    if (!shade)
+        return blitFast(fb, dx, dy, sx, sy, sw, sh);
+    if (deferBlit(fb, DrawOp::BlitFastModulated, this,
+                dx, dy, sx, sy, sw, sh, shade))
+        return;
+    if (fb.overdraw())
+        countBlit<false>(fb, _width, _height, pixels(), _stride, true,
+                dx, dy, sx, sy, sw, sh);
+    doBlit<false, true, false, true>(fb, _width, _height, pixels(), _stride,
+            dx, dy, sx, sy, sw, sh, shade);
+}
+
+void Image::blitAdditiveModulated(Image &fb, int dx, int dy,
+                int sx, int sy, int sw, int sh, Color shade)
+{
+    if (!shade)
+        return blitAdditive(fb, dx, dy, sx, sy, sw, sh);
+    if (deferBlit(fb, DrawOp::BlitAdditiveModulated, this,
+                dx, dy, sx, sy, sw, sh, shade))
+        return;
+    if (fb.overdraw())
+        countBlit<false>(fb, _width, _height, pixels(), _stride, true,
+                dx, dy, sx, sy, sw, sh);
+    doBlit<false, true, true, true>(fb, _width, _height, pixels(), _stride,
+            dx, dy, sx, sy, sw, sh, shade);
+}
+
 void Image::add(Color color)
 {
-    std::transform(_data.begin(), _data.end(), _data.begin(),
-            [color](const Color &c) { return c + color; });
+    if (_recorder)
+        return _recorder->addColor(DrawOp::Add, color, 0, 0, _width, _height);
+    if (_overdraw)
+        _overdraw->countRect(0, 0, _width, _height);
+    detach();
+    dropSpans();
+    ColorRowAdd(_data.data(), _data.size(), color);
 }
 
 void Image::subtract(Color color)
 {
-    std::transform(_data.begin(), _data.end(), _data.begin(),
-            [color](const Color &c) { return c - color; });
+    if (_recorder)
+        return _recorder->addColor(DrawOp::Subtract, color,
+                0, 0, _width, _height);
+    if (_overdraw)
+        _overdraw->countRect(0, 0, _width, _height);
+    detach();
+    dropSpans();
+    ColorRowSubtract(_data.data(), _data.size(), color);
 }
 
 void Image::addSolid(Color color)
 {
-    std::transform(_data.begin(), _data.end(), _data.begin(),
-            [color](const Color &c) { return c ? c + color : c; });
+    detach();
+    ColorRowAddSolid(_data.data(), _data.size(), color);
 }
 
 void Image::subtractSolid(Color color)
 {
-    std::transform(_data.begin(), _data.end(), _data.begin(),
-            [color](const Color &c) { return c ? c - color : c; });
+    detach();
+    ColorRowSubtractSolid(_data.data(), _data.size(), color);
 }
 
-void Image::addSolid(Color color, int x, int y, int w, int h)
+// applies a row kernel to the part of the rectangle inside the image
+static inline void colorRect(std::vector<Color> &data, int width, int height,
+                ColorRowKernel kernel, Color color,
+                int x, int y, int w, int h)
 {
     if (x < 0)
     {
@@ -217,48 +590,86 @@ void Image::addSolid(Color color, int x, int y, int w, int h)
         h += y;
         y = 0;
     }
-    w = std::min(w, _width - x), h = std::min(h, _height - y);
+    w = std::min(w, width - x), h = std::min(h, height - y);
     if (w > 0 && h > 0)
     {
-        auto it = _data.begin() + y * _width + x;
+        auto it = data.begin() + y * width + x;
         for (int oy = 0; oy < h; ++oy)
         {
-            std::transform(it, it + w, it,
-                    [color](const Color &c) { return c ? c + color : c; });
-            it += _width;
+            kernel(&*it, w, color);
+            it += width;
         }
     }
 }
 
+static void fillRow(Color *dst, int n, Color color)
+{
+    std::fill(dst, dst + n, color);
+}
+
+void Image::clear(int x, int y, int w, int h)
+{
+    if (_recorder)
+        return _recorder->addColor(DrawOp::Clear, Color::transparent,
+                x, y, w, h);
+    if (_overdraw)
+        _overdraw->countRect(x, y, w, h);
+    detach();
+    dropSpans();
+    colorRect(_data, _width, _height, fillRow, Color::transparent,
+            x, y, w, h);
+}
+
+void Image::addSolid(Color color, int x, int y, int w, int h)
+{
+    detach();
+    colorRect(_data, _width, _height, ColorRowAddSolid, color, x, y, w, h);
+}
+
 void Image::subtractSolid(Color color, int x, int y, int w, int h)
 {
-    if (x < 0)
-    {
-        w += x; 
-        x = 0;
-    }
-    if (y < 0)
-    {
-        h += y;
-        y = 0;
-    }
-    w = std::min(w, _width - x), h = std::min(h, _height - y);
-    if (w > 0 && h > 0)
-    {
-        auto it = _data.begin() + y * _width + x;
-        for (int oy = 0; oy < h; ++oy)
-        {
-            std::transform(it, it + w, it,
-                    [color](const Color &c) { return c ? c - color : c; });
-            it += _width;
-        }
-    }
+    detach();
+    colorRect(_data, _width, _height, ColorRowSubtractSolid, color,
+            x, y, w, h);
+}
+
+void Image::add(Color color, int x, int y, int w, int h)
+{
+    if (_recorder)
+        return _recorder->addColor(DrawOp::Add, color, x, y, w, h);
+    if (_overdraw)
+        _overdraw->countRect(x, y, w, h);
+    detach();
+    dropSpans();
+    colorRect(_data, _width, _height, ColorRowAdd, color, x, y, w, h);
+}
+
+void Image::subtract(Color color, int x, int y, int w, int h)
+{
+    if (_recorder)
+        return _recorder->addColor(DrawOp::Subtract, color, x, y, w, h);
+    if (_overdraw)
+        _overdraw->countRect(x, y, w, h);
+    detach();
+    dropSpans();
+    colorRect(_data, _width, _height, ColorRowSubtract, color, x, y, w, h);
+}
+
+// whether a pixel is opaque in both rows. the whole row is tested without
+// stopping early, so that the loop can be vectorized
+static inline REALLY_INLINE bool rowsOverlap(const Color *self,
+                    const Color *other, int n)
+{
+    unsigned hit = 0;
+    for (int i = 0; i < n; ++i)
+        hit |= (self[i].v != 0) & (other[i].v != 0);
+    return hit;
 }
 
 // only *this* image will be tiled
 template <bool tiled>
-static inline REALLY_INLINE bool overlapsImage(Image &other,
-                    int mw, int mh, const std::vector<Color> &_data,
+static inline REALLY_INLINE bool overlapsImage(const Image &other,
+                    int mw, int mh, const Color *data, int ms,
                     int x, int y, int ox, int oy, int w, int h)
 {
     int fbs = other.width(), fbh = other.height();
@@ -283,32 +694,24 @@ static inline REALLY_INLINE bool overlapsImage(Image &other,
 
     if (w <= 0 || h <= 0) return false;
 
-    int osrcx = remainder(x, mw), srcx = osrcx, srcy = remainder(y, mh);
-    auto self = _data.begin() + (srcy * mw + srcx);
-    auto othr = other.buffer().begin() + (oy * fbs + ox);
-    int self_off = mw - w, othr_off = fbs - w;
-    int xo, yo;
+    int osrcx = remainder(x, mw), srcx, srcy = remainder(y, mh);
+    const Color *self;
+    const Color *othr = other.pixels() + (oy * other.stride() + ox);
+    int xo, yo, n;
     for (yo = 0; yo < h; ++yo)
     {
-        srcx = osrcx;
-        for (xo = 0; xo < w; ++xo, ++self, ++othr)
+        // tested in pieces that end at the right image edge, as in doBlit
+        self = data + srcy * ms;
+        for (xo = 0, srcx = osrcx; xo < w; xo += n, srcx = 0)
         {
-            if (*self && *othr)
+            n = std::min(w - xo, mw - srcx);
+            if (rowsOverlap(self + srcx, othr + xo, n))
                 return true;
-            if (tiled && ++srcx == mw)
-            {
-                self -= mw;
-                srcx -= mw;
-            }
         }
 
-        self += self_off;
-        othr += othr_off;
-        if (tiled && ++srcy == mh)
-        {
-            self -= _data.size();
-            srcy -= mh;
-        }
+        othr += other.stride();
+        if (++srcy == mh)
+            srcy = 0;
     }
 
     return false;
@@ -317,7 +720,7 @@ static inline REALLY_INLINE bool overlapsImage(Image &other,
 bool Image::overlaps(Image &other, int x, int y,
                         int ox, int oy, int w, int h) const
 {
-    return overlapsImage<false>(other, _width, _height, _data,
+    return overlapsImage<false>(other, _width, _height, pixels(), _stride,
                                 x, y, ox, oy, w, h);
 }
 
@@ -325,6 +728,6 @@ bool Image::overlaps(Image &other, int x, int y,
 bool Image::overlapsTiled(Image &other, int x, int y,
                         int ox, int oy, int w, int h) const
 {
-    return overlapsImage<true>(other, _width, _height, _data,
+    return overlapsImage<true>(other, _width, _height, pixels(), _stride,
                                 x, y, ox, oy, w, h);
 }
@@ -24,8 +24,10 @@
 #include "maths.hh"
 #include "object.hh"
 #include "bullet.hh"
+#include "enemy.hh"
 #include "powerup.hh"
 #include "scores.hh"
+#include "overdraw.hh"
 
 std::shared_ptr<Shooter> stg;
 
@@ -59,7 +61,10 @@ void StartNewGame()
 
 void UnloadGame()
 {
+    // the frame being drawn may still use the game area
+    FinishFrame();
     stg = nullptr;
+    ClearEnemyFlashCache();
 }
 
 inline void ScreenPopup::blit(Image &fb)
@@ -71,23 +76,33 @@ inline void ScreenPopup::blit(Image &fb)
         visibility = ScreenPopup::LENGTH - ticks;
     if (visibility)
     {
-        back.blit(front);
         int n = std::max(0, S_MAXCLR - visibility);
-        front.subtract(Color(n, n, n));
-        front.blitAdditive(fb, 0, 80, 0, 0, S_WIDTH, 32);
+        back.blitAdditiveModulated(fb, 0, 80, 0, 0, S_WIDTH, 32,
+                                   Color(n, n, n));
     }
-    if (!--ticks)
+    if (!renderBetweenTicks)
+        advance();
+}
+
+inline void ScreenPopup::advance()
+{
+    if (ticks && !--ticks)
     {
         visibility = 0;
         ticks += permanent;
     }
 }
 
+// hidden, or fully shown and staying on screen
+bool ScreenPopup::isStatic() const
+{
+    return !ticks || (permanent && ticks == 1);
+}
+
 void ScreenPopup::clear()
 {
     ticks = visibility = 0;
     back.clear();
-    front.clear();
 }
 
 void ScreenPopup::showString(std::string text)
@@ -132,7 +147,8 @@ void ScreenPopup::showGameOver()
 
 inline void Shooter::blitPlayer(Image &fb, int oy)
 {
-    int px = static_cast<int>(player->x()), py = static_cast<int>(player->y());
+    int px = static_cast<int>(player->drawX());
+    int py = static_cast<int>(player->drawY());
     if (!player->hasFlag(SPRITE_NODRAW))
         player->blit(gameArea, 0, oy);
     if (player->hasShield() && !(totalFrames & 1))
@@ -141,8 +157,13 @@ inline void Shooter::blitPlayer(Image &fb, int oy)
 
 void Shooter::blit(Image &fb)
 {
-    fb.clear();
-    ++totalFrames;
+    // the game area is copied over everything under the HUD
+    if (stage && !(_isGameOver || _isComplete || paused || continueScreen))
+        fb.clear(0, 0, S_WIDTH, S_HUDHEIGHT);
+    else
+        fb.clear();
+    if (!renderBetweenTicks)
+        ++totalFrames;
     if (_isGameOver || _isComplete)
     {
         if (_isComplete)
@@ -162,43 +183,87 @@ void Shooter::blit(Image &fb)
     }
     if (stage)
     {
-        int oy = static_cast<int>(-stg->scroll.y);
-        for (auto &bl : stage->backgroundLayers)
-            bl->blitIfShown(gameArea, stg->scroll);
+        LayerScroll view(Interpolate(prevScroll.x, scroll.x),
+                         Interpolate(prevScroll.y, scroll.y));
+        int oy = static_cast<int>(-view.y);
+        // a profiled game area is drawn one layer at a time
+        bool profiled = ProfileBeginFrame(gameArea);
+        if (!profiled)
+            gameRenderer.begin(fb);
+        stage->blitBackground(gameArea, view);
         hud.blit(fb);
+        ProfileLayer("sprites", 0);
         for (auto &sprite : spriteLayer0)
             if (!sprite->hasFlag(SPRITE_NODRAW))
                 sprite->blit(gameArea, 0, oy);
-        for (auto &fl : stage->terrainLayers)
-            fl->blit(gameArea, stg->scroll);
+        stage->blitTerrain(gameArea, view);
+        ProfileLayer("sprites", 1);
         for (auto &sprite : spriteLayer1)
             if (!sprite->hasFlag(SPRITE_NODRAW))
                 sprite->blit(gameArea, 0, oy);
+        ProfileLayer("sprites", 2);
         for (auto &sprite : spriteLayer2)
             if (!sprite->hasFlag(SPRITE_NODRAW))
                 sprite->blit(gameArea, 0, oy);
+        ProfileLayer("drones");
         for (auto &sprite : drones)
             if (!sprite->hasFlag(SPRITE_NODRAW))
                 sprite->blit(gameArea, 0, oy);
+        ProfileLayer("player");
         if (player)
             blitPlayer(gameArea, oy);
+        ProfileLayer("sprites", 3);
         for (auto &sprite : spriteLayer3)
             if (!sprite->hasFlag(SPRITE_NODRAW))
                 sprite->blit(gameArea, 0, oy);
+        ProfileLayer("sprites", 4);
         for (auto &sprite : spriteLayer4)
             if (!sprite->hasFlag(SPRITE_NODRAW))
                 sprite->blit(gameArea, 0, oy);
-        for (auto &bl : stage->foregroundLayers)
-            bl->blitIfShown(gameArea, stg->scroll);
+        stage->blitForeground(gameArea, view);
+        ProfileLayer("effects");
         flashfx.blit(gameArea);
-        fade.blit(gameArea);
-        gameArea.blitFast(fb, 0, S_HUDHEIGHT, 0, 0, S_WIDTH, S_GHEIGHT);
+        if (profiled)
+            ProfileEndFrame(gameArea);
+        else
+            gameRenderer.end(fb);
+        // the fade covers the whole game area, so it is applied as the
+        // game area is copied
+        gameArea.blitFastModulated(fb, 0, S_HUDHEIGHT,
+                0, 0, S_WIDTH, S_GHEIGHT, fade.color());
     } else
         hud.blit(fb);
     text.blit(fb);
     popup->blit(fb);
 }
 
+// keeps the frame counters and layer animations of blit() going when a
+// frame is skipped
+void Shooter::skipFrame()
+{
+    ++totalFrames;
+    if (_isGameOver || _isComplete || !(paused || continueScreen))
+        popup->advance();
+    if (stage && !(_isGameOver || _isComplete || paused || continueScreen))
+        stage->advanceLayers();
+}
+
+// the pause and continue screens only change on input, and the end of the
+// game only when the popup or the text on it changes
+bool Shooter::isStatic() const
+{
+    if (_isGameOver || _isComplete)
+        return popup->isStatic();
+    return paused || continueScreen;
+}
+
+bool Shooter::takeChanges()
+{
+    bool changed = hud.takeChanges();
+    changed |= menu.takeChanges();
+    return changed || menuInput.any();
+}
+
 void Shooter::flashScreen(Color color, int permanence /*= 1*/)
 {
     flashfx.flash(color);
@@ -413,6 +478,8 @@ void Shooter::endStage()
 
 void Shooter::unloadStage()
 {
+    // the frame being drawn may still use the game area and the stage
+    FinishFrame();
     gameArea.clear();
     spriteLayer0.clear();
     spriteLayer1.clear();
@@ -426,6 +493,7 @@ void Shooter::unloadStage()
     spriteLayer3.clear();
     spriteLayer4.clear();
     stage = nullptr;
+    ClearEnemyFlashCache();
 }
 
 void Shooter::runScript(int delay, int scriptNum)
@@ -448,8 +516,9 @@ void Shooter::runScript(int delay, int scriptNum)
 
 void Shooter::pauseGame()
 {
-    fb_back.blit(pauseBuffer);
-    pauseBuffer.subtract(Color(8, 8, 8));
+    FinishFrame();
+    fb_back.blitFastModulated(pauseBuffer, 0, 0, 0, 0, S_WIDTH, S_HEIGHT,
+                              Color(8, 8, 8));
     menu.writeString(menuFont, 18, 10, "PAUSE");
     menu.writeString(menuFont, 18, 16, "CONTINUE");
     menu.writeString(menuFont, 18, 18, "EXIT");
@@ -459,8 +528,9 @@ void Shooter::pauseGame()
 
 void Shooter::tryContinue()
 {
-    fb_back.blit(pauseBuffer);
-    pauseBuffer.subtract(Color(8, 8, 8));
+    FinishFrame();
+    fb_back.blitFastModulated(pauseBuffer, 0, 0, 0, 0, S_WIDTH, S_HEIGHT,
+                              Color(8, 8, 8));
     if (!continues)
     {
         gameOver();
@@ -766,10 +836,26 @@ void Shooter::respawnPlayer()
     player->respawned();
 }
 
+// interpolated frames are drawn between these and the positions after
+// the tick
+void Shooter::savePositions()
+{
+    prevScroll = scroll;
+    for (auto *layer : { &spriteLayer0, &spriteLayer1, &spriteLayer2,
+                         &spriteLayer3, &spriteLayer4 })
+        for (auto &sprite : *layer)
+            sprite->savePosition();
+    for (auto &sprite : drones)
+        sprite->savePosition();
+    if (player)
+        player->savePosition();
+}
+
 void Shooter::tick()
 {
     if (!_isComplete && !stage)
         loadStage(++stageNum);
+    savePositions();
     if (!usedContinue)
     {
         if (pauseTick()) return;
@@ -962,7 +1048,19 @@ void RenderGame(Image &fb)
     stg->blit(fb);
 }
 
+void SkipGameFrame()
+{
+    stg->skipFrame();
+}
+
+bool IsGameFrameStatic()
+{
+    return stg && stg->isStatic();
+}
+
 void DoGameTick()
 {
     stg->tick();
+    if (stg && stg->takeChanges())
+        InvalidateFrame();
 }
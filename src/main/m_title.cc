@@ -6,6 +6,7 @@
 /****************************************************************************/
 // m_title.cc: code for the title screen
 
+#include <array>
 #include <memory>
 #include "defs.hh"
 #include "layer.hh"
@@ -622,20 +623,11 @@ void TitleScreen::draw(Image &fb)
     {
         fb.subtract(Color(1, 1, 1));
         int yScale = 256 - (logoStretchFrames << 1);
-        int logoWidth = gameLogo->width();
-        int y = -128;
-        int yt;
-        for (;;)
-        {
-            yt = ((y - 32) * yScale) >> 8;
-            if (y >= 0 && yt >= 0)
-            {
-                if (yt >= logoHeight || y >= S_HEIGHT)
-                    break;
-                gameLogo->blit(fb, 32, y, 0, yt, logoWidth, 1);
-            }
-            ++y;
-        }
+        std::array<RasterLine, S_HEIGHT> lines;
+        for (int y = 0; y < S_HEIGHT; ++y)
+            lines[y] = { 0, ((y - 32) * yScale) >> 8 };
+        gameLogo->blitRaster(fb, 32, 0, gameLogo->width(),
+                lines.data(), S_HEIGHT);
         break;
     }
     case TitleMode::MainMenu:
@@ -658,6 +650,21 @@ void TitleScreen::draw(Image &fb)
     }
 }
 
+// the menus only move on input; the logo animation, the flash and the
+// blinking name entry cursor move on their own
+bool TitleScreen::isStatic() const
+{
+    return mode != TitleMode::InitAnimationScale && !flash.hasColor()
+        && nameEntryCharIndex < 0;
+}
+
+// the cursor and options only change on input, but a control being set
+// may be pressed on the keyboard or gamepad without any menu input
+bool TitleScreen::takeChanges()
+{
+    return textLayer.takeChanges() || menuInput.any();
+}
+
 void TitleScreen::tick()
 {
     ++ticks;
@@ -829,7 +836,14 @@ void DrawTitleFrame(Image &fb)
     title->draw(fb);
 }
 
+bool IsTitleFrameStatic()
+{
+    return title && title->isStatic();
+}
+
 void RunTitleFrame()
 {
     title->tick();
+    if (title && title->takeChanges())
+        InvalidateFrame();
 }
@@ -7,6 +7,7 @@
 // malpinx.cc: main game executable
 
 #include <memory>
+#include <algorithm>
 #include "malpinx.hh"
 #include "backend.hh"
 #include "logic.hh"
@@ -14,16 +15,76 @@
 #include "config.hh"
 #include "gamedata.hh"
 #include "scores.hh"
+#include "blit.hh"
+#include "capture.hh"
+#include "fbexport.hh"
 
 int sampleRate;
 std::unique_ptr<GameBackend> backend;
 static bool running;
+unsigned long framesDrawn = 0, framesSkipped = 0, longestFrameSkip = 0;
+unsigned long framesUnchanged = 0;
+// frames are skipped from when a tick ends behind schedule until one ends
+// with at least this much of a tick to spare
+constexpr double FRAMESKIP_RESUME = 0.5;
+static bool skippingFrames = false;
+static int framesSkippedInRow = 0;
 
 // always 10 chars           ----------
 const std::string VERSION = "PREALPHA 6";
 
+// an unchanged frame is shown again without converting it
+static void FlipFrame(bool changed)
+{
+    CaptureFrame(changed);
+    ExportFrame(changed);
+    if (changed)
+        backend->flip();
+    else
+    {
+        backend->repeat();
+        ++framesUnchanged;
+    }
+}
+
+static void ShowFrame()
+{
+    // whether the frame drawn last on the render thread changed
+    static bool queuedChanged = true;
+    if (HasRenderThread())
+    {
+        // the previous frame was drawn during the tick
+        FinishFrame();
+        FlipFrame(queuedChanged);
+        queuedChanged = DrawFrame();
+    }
+    else
+        FlipFrame(DrawFrame());
+}
+
+static bool SkipNextFrame()
+{
+    if (!maxFrameSkip)
+        return false;
+    double lateness = backend->lateness();
+    if (lateness > 0)
+        skippingFrames = true;
+    else if (lateness < -FRAMESKIP_RESUME)
+        skippingFrames = false;
+    if (!skippingFrames || framesSkippedInRow >= maxFrameSkip || !SkipFrame())
+    {
+        framesSkippedInRow = 0;
+        return false;
+    }
+    ++framesSkipped;
+    longestFrameSkip = std::max<unsigned long>(longestFrameSkip,
+                                               ++framesSkippedInRow);
+    return true;
+}
+
 void DoGame()
 {
+    InitBlitKernels();
     LoadConfig();
     backend = std::make_unique<GameBackend>(GetConfigSampleRate());
     ApplySettingsToBackend();
@@ -34,17 +95,49 @@ void DoGame()
     JumpMode(GameMode::Logo);
     InitLogo(1, "logo");
     running = true;
+    if (pipelinedRendering)
+        StartRenderThread();
+    StartCapture();
+    StartFramebufferExport();
     
     while (running && backend->run())
     {
         UpdateInput();
         RunFrame();
-        DrawFrame();
-        backend->blit();
+        if (SkipNextFrame())
+        {
+            CaptureSkippedFrame();
+            backend->sync();
+            continue;
+        }
+        ++framesDrawn;
+        // on a display faster than the tick rate, the refreshes in between
+        // ticks get frames of their own
+        double blend;
+        bool extra = interpolateFrames && backend->nextRefresh(blend, false);
+        renderBlend = extra ? Fix(blend) : 1_x;
+        ShowFrame();
+        renderBetweenTicks = true;
+        while (extra && backend->nextRefresh(blend, true))
+        {
+            renderBlend = Fix(blend);
+            ShowFrame();
+        }
+        renderBetweenTicks = false;
+        backend->sync();
     }
 
+    StopRenderThread();
+    StopCapture();
+    StopFramebufferExport();
+    if (maxFrameSkip)
+        DEBUG_LOG("Frames drawn: ", framesDrawn, ", skipped: ",
+                framesSkipped, ", at most ", longestFrameSkip, " in a row");
+    DEBUG_LOG("Frames unchanged: ", framesUnchanged);
     SaveConfig();
     SaveHighScores();
+    // the backend stops its threads before anything static is destroyed
+    backend.reset();
 }
 
 void QuitGame()
@@ -111,4 +111,5 @@ ScoreSprite::ScoreSprite(int id, Fix x, Fix y, int score)
     }
     updateImage(tmp);
     _x -= _width / 2;
+    savePosition();
 }
@@ -0,0 +1,180 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// overdraw.cc: overdraw and layer cost profiling
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <memory>
+#include "overdraw.hh"
+#include "image.hh"
+
+bool profileLayers;
+bool overdrawHeatMap;
+
+// by the number of writes; the last also stands for any more than that
+static const Color heatColors[] = {
+    Color(0, 0, 0), Color(0, 0, 10), Color(0, 9, 0), Color(12, 12, 0),
+    Color(14, 7, 0), Color(15, 0, 0), Color(15, 0, 9), Color(15, 15, 15)
+};
+constexpr int HEAT_LEVELS = sizeof(heatColors) / sizeof(heatColors[0]);
+
+OverdrawMap::OverdrawMap(int width, int height)
+    : _width(width), _height(height), _counts(width * height), _written(0)
+{
+}
+
+void OverdrawMap::reset()
+{
+    std::fill(_counts.begin(), _counts.end(), 0);
+    _written = 0;
+}
+
+void OverdrawMap::countRow(int x, int y, const Color *src, int n)
+{
+    if (y < 0 || y >= _height)
+        return;
+    if (x < 0)
+    {
+        if (src)
+            src -= x;
+        n += x;
+        x = 0;
+    }
+    n = std::min(n, _width - x);
+    std::uint8_t *count = _counts.data() + (y * _width + x);
+    for (int i = 0; i < n; ++i)
+    {
+        if (src && src[i].isTransparent())
+            continue;
+        if (count[i] < UINT8_MAX)
+            ++count[i];
+        ++_written;
+    }
+}
+
+void OverdrawMap::countRect(int x, int y, int w, int h)
+{
+    int y1 = std::min(y + h, _height);
+    for (y = std::max(y, 0); y < y1; ++y)
+        countRow(x, y, nullptr, w);
+}
+
+// keeps a quarter of the brightness of each pixel, so that the picture
+// can still be made out under the heat colors
+void OverdrawMap::drawHeatMap(Image &dst) const
+{
+    int w = std::min(_width, dst.width()), h = std::min(_height, dst.height());
+    Color *row = dst.buffer().data();
+    const std::uint8_t *count = _counts.data();
+    for (int y = 0; y < h; ++y, row += dst.width(), count += _width)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            Color heat = heatColors[std::min<int>(count[x], HEAT_LEVELS - 1)];
+            Color c = row[x];
+            row[x] = Color(heat.getR() + c.getR() / 4,
+                           heat.getG() + c.getG() / 4,
+                           heat.getB() + c.getB() / 4);
+        }
+    }
+}
+
+using ProfileClock = std::chrono::steady_clock;
+
+struct LayerCost
+{
+    const char *name;
+    int index;
+    unsigned long pixels;
+    ProfileClock::duration time;
+};
+
+static std::unique_ptr<OverdrawMap> profileMap;
+static std::vector<LayerCost> frameCosts;
+static ProfileClock::time_point frameStart, layerStart;
+static unsigned long layerWritten;
+static unsigned long profiledFrames = 0;
+static bool profiling = false;
+
+static inline long Microseconds(ProfileClock::duration time)
+{
+    return static_cast<long>(
+        std::chrono::duration_cast<std::chrono::microseconds>(time).count());
+}
+
+static void EndLayer()
+{
+    ProfileClock::time_point now = ProfileClock::now();
+    if (!frameCosts.empty())
+    {
+        LayerCost &cost = frameCosts.back();
+        cost.pixels = profileMap->written() - layerWritten;
+        cost.time = now - layerStart;
+    }
+    layerWritten = profileMap->written();
+    layerStart = now;
+}
+
+bool ProfileBeginFrame(Image &target)
+{
+    if (!profileLayers && !overdrawHeatMap)
+        return false;
+    if (!profileMap || profileMap->width() != target.width()
+                    || profileMap->height() != target.height())
+        profileMap = std::make_unique<OverdrawMap>(
+                        target.width(), target.height());
+    profileMap->reset();
+    target.setOverdraw(profileMap.get());
+    frameCosts.clear();
+    layerWritten = 0;
+    frameStart = layerStart = ProfileClock::now();
+    profiling = true;
+    return true;
+}
+
+void ProfileLayer(const char *name, int index)
+{
+    if (!profiling)
+        return;
+    EndLayer();
+    frameCosts.push_back({ name, index, 0, ProfileClock::duration() });
+}
+
+void ProfileEndFrame(Image &target)
+{
+    if (!profiling)
+        return;
+    EndLayer();
+    profiling = false;
+    target.setOverdraw(nullptr);
+    ++profiledFrames;
+    if (profileLayers)
+    {
+        long total = Microseconds(ProfileClock::now() - frameStart);
+        unsigned long area = target.width() * target.height();
+        std::ostringstream line;
+        line << "Frame " << profiledFrames << ": " << total << " us, "
+             << profileMap->written() << " px ("
+             << (100 * profileMap->written() / area) << "% of area)";
+        if (total > static_cast<long>(S_TICK_US))
+            line << " OVER BUDGET";
+        for (const LayerCost &cost : frameCosts)
+        {
+            if (!cost.pixels && cost.time < std::chrono::microseconds(1))
+                continue;
+            line << "; " << cost.name;
+            if (cost.index >= 0)
+                line << cost.index;
+            line << " " << cost.pixels << " px " << Microseconds(cost.time)
+                 << " us";
+        }
+        DEBUG_LOG(line.str());
+    }
+    if (overdrawHeatMap)
+        profileMap->drawHeatMap(target);
+}
@@ -209,7 +209,7 @@ DroneSprite::DroneSprite(Shooter &stg, int id,
 
 void DroneSprite::blit(Image &fb, int xoff, int yoff) const
 {
-    int ox = (_x + xoff).round(), oy = (_y + yoff).round();
+    int ox = (drawX() + xoff).round(), oy = (drawY() + yoff).round();
     game.assets.drone0->blit(fb,
         (6 * game.activeWeapon) + ((_ticks / 3) % 6), ox + 2, oy + 2);
     game.assets.drone1->blit(fb, (_ticks / 6) % 8, ox, oy);
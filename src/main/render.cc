@@ -8,15 +8,45 @@
 
 #include <algorithm>
 #include <iterator>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "render.hh"
+#include "binrender.hh"
 #include "logic.hh"
 #include "modes.hh"
 
 Image fb_back(S_WIDTH, S_HEIGHT);
-Image fb_front(S_WIDTH, S_HEIGHT);
 Color flashColor, fadeColor;
 const Color normalizingColor = Color(1, 1, 1);
 bool isFading = false;
+Fix renderBlend = 1_x;
+bool renderBetweenTicks = false;
+// fade level when the frame in fb_back was drawn
+static int frameFadeLevel = 0;
+// set if a static screen must be drawn again, and if fb_back has been
+// drawn on since the last frame
+static bool frameDirty = true;
+static bool frameChanged = true;
+
+static std::thread renderThread;
+static std::mutex renderMutex;
+static std::condition_variable renderWake;
+static std::condition_variable renderDone;
+// the render thread draws one list while the other is recorded into
+static DrawList frameLists[2];
+static int recordedList = 0;
+static DrawList *queuedList = nullptr;
+static bool frameQueued = false;
+static bool renderQuit = false;
+// drawn on instead of fb_back while there is a render thread; everything
+// drawn on it is recorded, so its own pixels are never used
+static Image fb_record(S_WIDTH, S_HEIGHT);
+
+static inline Image &FrameTarget()
+{
+    return renderThread.joinable() ? fb_record : fb_back;
+}
 
 void FadeReset()
 {
@@ -42,16 +72,22 @@ bool FadeStepIn()
     return static_cast<bool>(fadeColor);
 }
 
+int GetFadeLevel()
+{
+    return frameFadeLevel;
+}
+
 static inline void DrawFrameBack()
 {
+    Image &fb = FrameTarget();
     switch (activeMode)
     {
     case GameMode::Logo:
-        DrawLogoFrame(fb_back); break;
+        DrawLogoFrame(fb); break;
     case GameMode::TitleScreen:
-        DrawTitleFrame(fb_back); break;
+        DrawTitleFrame(fb); break;
     case GameMode::Game:
-        RenderGame(fb_back); break;
+        RenderGame(fb); break;
     case GameMode::Ending:
         break;
     case GameMode::NameEntry:
@@ -59,27 +95,147 @@ static inline void DrawFrameBack()
     }
 }
 
-static inline void DrawFrameFront()
+// moves on what drawing the frame would have, without drawing it
+static inline void SkipFrameBack()
 {
-    std::copy(fb_back.buffer().begin(), fb_back.buffer().end(), 
-            fb_front.buffer().begin());
-    if (fadeColor)
-        fb_front.subtract(fadeColor);
+    if (activeMode == GameMode::Game && !renderBetweenTicks)
+        SkipGameFrame();
+}
+
+static inline bool IsFrameStatic()
+{
+    switch (activeMode)
+    {
+    case GameMode::Logo:
+        return true;
+    case GameMode::TitleScreen:
+        return IsTitleFrameStatic();
+    case GameMode::Game:
+        return IsGameFrameStatic();
+    default:
+        return false;
+    }
 }
 
 void ClearScreen()
 {
-    std::fill(fb_back.buffer().begin(), fb_back.buffer().end(),
-            Color::transparent);
+    FrameTarget().clear();
+    frameDirty = frameChanged = true;
 }
 
 void UpdateBackbuffer()
 {
     DrawFrameBack();
+    frameChanged = true;
+}
+
+void InvalidateFrame()
+{
+    frameDirty = true;
+}
+
+bool DrawFrame()
+{
+    FinishFrame();
+    // fades only ever step all three channels together
+    int fadeLevel = fadeColor.getR();
+    bool changed = frameChanged || fadeLevel != frameFadeLevel;
+    frameFadeLevel = fadeLevel;
+    frameChanged = false;
+    // only the game is drawn again between ticks. a static screen is drawn
+    // once more after it becomes static, then not until invalidated.
+    if (!isFading && (!renderBetweenTicks || activeMode == GameMode::Game))
+    {
+        if (frameDirty || !IsFrameStatic())
+        {
+            DrawFrameBack();
+            frameDirty = !IsFrameStatic();
+            changed = true;
+        }
+        else
+            SkipFrameBack();
+    }
+    if (!renderThread.joinable() || frameLists[recordedList].empty())
+        return changed;
+    // everything drawn since the last frame, including during the tick,
+    // was recorded into this list
+    {
+        std::lock_guard<std::mutex> lock(renderMutex);
+        queuedList = &frameLists[recordedList];
+        frameQueued = true;
+    }
+    renderWake.notify_one();
+    recordedList ^= 1;
+    fb_record.setRecorder(&frameLists[recordedList]);
+    return true;
+}
+
+// only the game is expensive enough to be worth skipping frames of
+bool SkipFrame()
+{
+    if (isFading || activeMode != GameMode::Game)
+        return false;
+    SkipGameFrame();
+    return true;
+}
+
+static void RenderThreadLoop()
+{
+    std::unique_lock<std::mutex> lock(renderMutex);
+    for (;;)
+    {
+        renderWake.wait(lock, [] { return frameQueued || renderQuit; });
+        if (!frameQueued)
+            return;
+        DrawList &list = *queuedList;
+        lock.unlock();
+        list.draw(fb_back);
+        list.clear();
+        lock.lock();
+        frameQueued = false;
+        renderDone.notify_all();
+    }
+}
+
+void StartRenderThread()
+{
+    if (renderThread.joinable())
+        return;
+    for (DrawList &list : frameLists)
+    {
+        list.clear();
+        list.setSnapshots(true);
+    }
+    renderQuit = false;
+    fb_record.setRecorder(&frameLists[recordedList]);
+    renderThread = std::thread(RenderThreadLoop);
+}
+
+void StopRenderThread()
+{
+    if (!renderThread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(renderMutex);
+        renderQuit = true;
+    }
+    renderWake.notify_one();
+    renderThread.join();
+    // draw what was recorded after the last frame
+    fb_record.setRecorder(nullptr);
+    frameLists[recordedList].draw(fb_back);
+    frameLists[recordedList].clear();
+}
+
+bool HasRenderThread()
+{
+    return renderThread.joinable();
 }
 
-void DrawFrame()
+void FinishFrame()
 {
-    if (!isFading) DrawFrameBack();
-    DrawFrameFront();
+    if (!renderThread.joinable())
+        return;
+    std::unique_lock<std::mutex> lock(renderMutex);
+    renderDone.wait(lock, [] { return !frameQueued; });
 }
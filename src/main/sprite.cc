@@ -15,7 +15,8 @@ int colGridHeight = S_HEIGHT;
 
 Sprite::Sprite(int id, std::shared_ptr<Image> img, Fix x, Fix y, int flags,
                 SpriteType type)
-    : _id(id), _x(x), _y(y), _flags(flags), _ticks(0), _type(type),
+    : _id(id), _x(x), _y(y), _prevX(x), _prevY(y),
+      _flags(flags), _colgrid(0), _ticks(0), _type(type),
       _dead(false)
 {
     updateImage(img);
@@ -23,7 +24,7 @@ Sprite::Sprite(int id, std::shared_ptr<Image> img, Fix x, Fix y, int flags,
 
 void Sprite::blit(Image &fb, int xoff, int yoff) const
 {
-    _img->blit(fb, _x.round() + xoff, _y.round() + yoff,
+    _img->blit(fb, drawX().round() + xoff, drawY().round() + yoff,
         0, 0, _img->width(), _img->height());
 }
 
@@ -62,3 +62,40 @@ void Stage::showLayer(int index)
 {
     backgroundLayers[index]->show();
 }
+
+// only the background layers have their opacity analyzed, so only they
+// are culled
+void Stage::buildCompositors()
+{
+    backgroundCompositor.build(backgroundLayers, "background", true);
+    terrainCompositor.build(terrainLayers, "terrain", false);
+    foregroundCompositor.build(foregroundLayers, "foreground", false);
+}
+
+void Stage::blitBackground(Image &fb, LayerScroll scroll)
+{
+    backgroundCompositor.draw(fb, scroll);
+}
+
+void Stage::blitTerrain(Image &fb, LayerScroll scroll)
+{
+    terrainCompositor.draw(fb, scroll);
+}
+
+void Stage::blitForeground(Image &fb, LayerScroll scroll)
+{
+    foregroundCompositor.draw(fb, scroll);
+}
+
+void Stage::advanceLayers()
+{
+    for (auto &layer : backgroundLayers)
+        if (layer->shown())
+            layer->advance();
+    for (auto &layer : terrainLayers)
+        if (layer->shown())
+            layer->advance();
+    for (auto &layer : foregroundLayers)
+        if (layer->shown())
+            layer->advance();
+}
@@ -0,0 +1,238 @@
+/****************************************************************************/
+/*                                                                          */
+/*   MALPINX SOURCE CODE (C) 2020      SAMPO HIPPELAINEN (HISAHI).          */
+/*   SEE THE LICENSE FILE IN THE SOURCE ROOT DIRECTORY FOR LICENSE INFO.    */
+/*                                                                          */
+/****************************************************************************/
+// upscale.cc: software upscaling filters
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include "upscale.hh"
+#include "blit.hh"
+
+// worker threads in addition to the thread calling scale()
+constexpr unsigned MAX_UPSCALE_WORKERS = 3;
+// source rows per band
+constexpr int UPSCALE_BAND_ROWS = 8;
+
+static const char *const filterNames[] = {
+    "none", "smooth", "scanlines", "crt"
+};
+
+UpscaleFilter GetUpscaleFilter(const std::string &name)
+{
+    for (int i = 0; i < static_cast<int>(std::size(filterNames)); ++i)
+        if (name == filterNames[i])
+            return static_cast<UpscaleFilter>(i);
+    return UpscaleFilter::None;
+}
+
+const char *GetUpscaleFilterName(UpscaleFilter filter)
+{
+    return filterNames[static_cast<int>(filter)];
+}
+
+Upscaler::Upscaler()
+    : _filter(UpscaleFilter::None), _factor(1),
+      _source((S_WIDTH + 2) * (S_HEIGHT + 2)),
+      _pass(Pass::Expand), _src(nullptr), _stride(0), _width(0), _rows(0),
+      _dst(nullptr), _pitch(0),
+      _generation(0), _busy(0), _quit(false), _nextBand(0)
+{
+}
+
+Upscaler::~Upscaler()
+{
+    stopWorkers();
+}
+
+void Upscaler::startWorkers()
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    unsigned workers = std::min(cores ? cores - 1 : 0, MAX_UPSCALE_WORKERS);
+    _quit = false;
+    _generation = 0;
+    for (unsigned i = 0; i < workers; ++i)
+        _workers.emplace_back(&Upscaler::workerLoop, this);
+}
+
+void Upscaler::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wake.notify_all();
+    for (auto &worker : _workers)
+        worker.join();
+    _workers.clear();
+}
+
+void Upscaler::configure(UpscaleFilter filter, int factor)
+{
+    // without a filter, frames are left as they are
+    _filter = filter;
+    _factor = filter == UpscaleFilter::None
+                ? 1 : clamp(factor, 1, MAX_UPSCALE);
+    // the workers only run while there is something to scale
+    if (!active())
+    {
+        stopWorkers();
+        return;
+    }
+    if (_workers.empty())
+        startWorkers();
+    if (_filter == UpscaleFilter::Smooth && _factor == 4)
+        _middle.resize((S_WIDTH * 2 + 2) * (S_HEIGHT * 2 + 2));
+    _scanline.assign(width(), Color(0x0FFF));
+    // each column of the grille only lets one of the channels through
+    // at full brightness
+    static const Color triad[] = { Color(0x00FF), Color(0x0F0F),
+                                   Color(0x0FF0) };
+    _grille.resize(width());
+    for (int x = 0; x < width(); ++x)
+        _grille[x] = triad[x % 3];
+}
+
+// repeats the outermost pixels of an image into the edge around it
+static void padEdges(Color *image, int stride, int width, int height)
+{
+    Color *row = image + stride + 1;
+    for (int y = 0; y < height; ++y, row += stride)
+    {
+        row[-1] = row[0];
+        row[width] = row[width - 1];
+    }
+    std::copy(image + stride, image + 2 * stride, image);
+    std::copy(image + height * stride, image + (height + 1) * stride,
+              image + (height + 1) * stride);
+}
+
+void Upscaler::scale(const Color *src, Color fade, void *dst, int pitch)
+{
+    constexpr int stride = S_WIDTH + 2;
+    // the fade also makes every pixel opaque, so that transparent and
+    // black pixels compare equal
+    Color *row = _source.data() + stride + 1;
+    for (int y = 0; y < S_HEIGHT; ++y, row += stride)
+        ColorRowCopySubtract(row, src + y * S_WIDTH, S_WIDTH, fade);
+    padEdges(_source.data(), stride, S_WIDTH, S_HEIGHT);
+
+    const Color *source = _source.data() + stride + 1;
+    switch (_filter)
+    {
+    case UpscaleFilter::Smooth:
+        if (_factor == 2)
+            run(Pass::Scale2x, source, stride, S_WIDTH, S_HEIGHT, dst, pitch);
+        else if (_factor == 3)
+            run(Pass::Scale3x, source, stride, S_WIDTH, S_HEIGHT, dst, pitch);
+        else
+        {
+            constexpr int middleStride = S_WIDTH * 2 + 2;
+            Color *middle = _middle.data();
+            run(Pass::Scale2x, source, stride, S_WIDTH, S_HEIGHT,
+                middle + middleStride + 1, middleStride * sizeof(Color));
+            padEdges(middle, middleStride, S_WIDTH * 2, S_HEIGHT * 2);
+            run(Pass::Scale2x, middle + middleStride + 1, middleStride,
+                S_WIDTH * 2, S_HEIGHT * 2, dst, pitch);
+        }
+        break;
+    default:
+        run(Pass::Expand, source, stride, S_WIDTH, S_HEIGHT, dst, pitch);
+        break;
+    }
+}
+
+void Upscaler::run(Pass pass, const Color *src, int stride, int width,
+                int rows, void *dst, int pitch)
+{
+    _pass = pass;
+    _src = src;
+    _stride = stride;
+    _width = width;
+    _rows = rows;
+    _dst = static_cast<unsigned char *>(dst);
+    _pitch = pitch;
+    _nextBand = 0;
+    if (!_workers.empty())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_generation;
+            _busy = _workers.size();
+        }
+        _wake.notify_all();
+    }
+    drawBands();
+    if (!_workers.empty())
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [this] { return _busy == 0; });
+    }
+}
+
+void Upscaler::drawBands()
+{
+    int count = (_rows + UPSCALE_BAND_ROWS - 1) / UPSCALE_BAND_ROWS;
+    for (int i; (i = _nextBand++) < count; )
+        drawBand(i);
+}
+
+void Upscaler::drawBand(int band)
+{
+    int y0 = band * UPSCALE_BAND_ROWS;
+    int y1 = std::min(y0 + UPSCALE_BAND_ROWS, _rows);
+    int n = _width * _factor;
+    const Color *row = _src + y0 * _stride;
+    Color *out[MAX_UPSCALE];
+    for (int y = y0; y < y1; ++y, row += _stride)
+    {
+        switch (_pass)
+        {
+        case Pass::Scale2x:
+            out[0] = outputRow(y * 2);
+            out[1] = outputRow(y * 2 + 1);
+            Scale2xRow(out, row - _stride, row, row + _stride, _width);
+            break;
+        case Pass::Scale3x:
+            for (int i = 0; i < 3; ++i)
+                out[i] = outputRow(y * 3 + i);
+            Scale3xRow(out, row - _stride, row, row + _stride, _width);
+            break;
+        case Pass::Expand:
+            for (int i = 0; i < _factor; ++i)
+                out[i] = outputRow(y * _factor + i);
+            ExpandRow(out[0], row, _width, _factor);
+            for (int i = 1; i < _factor; ++i)
+                std::memcpy(out[i], out[0], n * sizeof(Color));
+            if (_filter == UpscaleFilter::CRT)
+                for (int i = 0; i < _factor - 1; ++i)
+                    BlitRowHalve(out[i], _grille.data(), n);
+            BlitRowHalve(out[_factor - 1], _scanline.data(), n);
+            break;
+        }
+    }
+}
+
+void Upscaler::workerLoop()
+{
+    unsigned long seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&] { return _quit || _generation != seen; });
+            if (_quit)
+                return;
+            seen = _generation;
+        }
+        drawBands();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!--_busy)
+                _done.notify_one();
+        }
+    }
+}
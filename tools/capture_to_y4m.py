@@ -0,0 +1,93 @@
+import sys
+import struct
+import array
+
+# converts a gameplay capture (see src/main/capture.cc) into a YUV4MPEG2
+# video, which most players and encoders take as is; for example
+#   capture_to_y4m.py run.cap - | ffmpeg -i - -c:v libx264 -crf 0 run.mkv
+
+MAGIC = b'MPXCAPT1'
+RUN_SAME, RUN_FILL, RUN_COPY = 0, 1, 2
+
+
+def make_tables():
+    # BT.601, limited range; each 4-bit channel is expanded to 8 bits.
+    # the tables are indexed by the whole 16-bit color, top bit included
+    y_table, cb_table, cr_table = bytearray(), bytearray(), bytearray()
+    for color in range(4096):
+        r = ((color >> 8) & 15) * 17
+        g = ((color >> 4) & 15) * 17
+        b = (color & 15) * 17
+        y_table.append(round(16 + (65.481 * r + 128.553 * g
+                                   + 24.966 * b) / 255))
+        cb_table.append(round(128 + (-37.797 * r - 74.203 * g
+                                     + 112.0 * b) / 255))
+        cr_table.append(round(128 + (112.0 * r - 93.786 * g
+                                     - 18.214 * b) / 255))
+    return y_table * 16, cb_table * 16, cr_table * 16
+
+
+def decode_frame(frame, data):
+    i, pos = 0, 0
+    while pos < len(data):
+        word, = struct.unpack_from('<H', data, pos)
+        pos += 2
+        kind, count = word >> 14, (word & 0x3FFF) + 1
+        if kind == RUN_SAME:
+            pass
+        elif kind == RUN_FILL:
+            color, = struct.unpack_from('<H', data, pos)
+            pos += 2
+            frame[i:i + count] = array.array('H', [color]) * count
+        elif kind == RUN_COPY:
+            colors = array.array('H', data[pos:pos + 2 * count])
+            if sys.byteorder != 'little':
+                colors.byteswap()
+            frame[i:i + count] = colors
+            pos += 2 * count
+        else:
+            raise ValueError('bad run in capture')
+        i += count
+    if i not in (0, len(frame)):
+        raise ValueError('frame size does not match capture')
+
+
+def main(*argv):
+    if len(argv) <= 2:
+        print(argv[0], '<capture_file>', '<output_y4m or ->')
+        return 2
+
+    with open(argv[1], 'rb') as source_file:
+        if source_file.read(len(MAGIC)) != MAGIC:
+            print('not a capture file:', argv[1])
+            return 1
+        width, height, fps = struct.unpack('<HHH', source_file.read(6))
+        tables = make_tables()
+        frame = array.array('H', [0]) * (width * height)
+        dest_file = (sys.stdout.buffer if argv[2] == '-'
+                     else open(argv[2], 'wb'))
+        dest_file.write('YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C444\n'.format(
+            width, height, fps).encode('ascii'))
+        frames = 0
+        planes = None
+        while True:
+            size = source_file.read(4)
+            if len(size) < 4:
+                break
+            size, = struct.unpack('<I', size)
+            if size or planes is None:
+                decode_frame(frame, source_file.read(size))
+                planes = b''.join(bytes(map(table.__getitem__, frame))
+                                  for table in tables)
+            dest_file.write(b'FRAME\n')
+            dest_file.write(planes)
+            frames += 1
+        if dest_file is not sys.stdout.buffer:
+            dest_file.close()
+
+    print(frames, 'frames converted', file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(*sys.argv) or 0)
@@ -0,0 +1,86 @@
+import sys
+import time
+import mmap
+import struct
+import array
+
+# reads the frames the game publishes in shared memory when
+# SharedFramebuffer is set (see src/includes/fbexport.hh), reports how
+# many it saw and how late, and can save the last one as a PPM image.
+# shared memory objects are files in /dev/shm on Linux
+
+MAGIC = b'MPXSHFB1'
+PIXELS_OFFSET = 64
+
+
+def read_frame(shared, size):
+    # retries until the sequence number is even and the same after reading
+    while True:
+        sequence, = struct.unpack_from('=I', shared, 12)
+        if sequence & 1:
+            continue
+        frame, timestamp = struct.unpack_from('=QQ', shared, 16)
+        pixels = shared[PIXELS_OFFSET:PIXELS_OFFSET + size]
+        if struct.unpack_from('=I', shared, 12)[0] == sequence:
+            return sequence, frame, timestamp, pixels
+
+
+def write_ppm(path, width, height, pixels):
+    colors = array.array('H', pixels)
+    rgb = bytearray()
+    for color in colors:
+        rgb += bytes((((color >> 8) & 15) * 17, ((color >> 4) & 15) * 17,
+                      (color & 15) * 17))
+    with open(path, 'wb') as dest_file:
+        dest_file.write('P6\n{} {}\n255\n'.format(width, height)
+                        .encode('ascii'))
+        dest_file.write(rgb)
+
+
+def main(*argv):
+    if len(argv) <= 1:
+        print(argv[0], '<shared_memory_name>', '[seconds]', '[output_ppm]')
+        return 2
+
+    name = argv[1].lstrip('/')
+    seconds = float(argv[2]) if len(argv) > 2 else 5
+    try:
+        with open('/dev/shm/' + name, 'rb') as shared_file:
+            shared = mmap.mmap(shared_file.fileno(), 0,
+                               access=mmap.ACCESS_READ)
+    except OSError as error:
+        print('cannot open shared memory', name + ':', error)
+        return 1
+    if shared[:len(MAGIC)] != MAGIC:
+        print('not a shared framebuffer:', name)
+        return 1
+    width, height = struct.unpack_from('=HH', shared, 8)
+
+    seen, missed, latency_total, latency_max = 0, 0, 0, 0
+    last_sequence, last_frame, pixels = None, None, None
+    end = time.monotonic() + seconds
+    while time.monotonic() < end:
+        sequence, frame, timestamp, pixels = read_frame(
+            shared, width * height * 2)
+        if sequence == last_sequence:
+            time.sleep(0.001)
+            continue
+        latency = time.monotonic() * 1000000 - timestamp
+        if last_frame is not None and frame > last_frame + 1:
+            missed += frame - last_frame - 1
+        last_sequence, last_frame = sequence, frame
+        seen += 1
+        latency_total += latency
+        latency_max = max(latency_max, latency)
+
+    print('frames seen:', seen, 'missed:', missed)
+    if seen:
+        print('latency: average {:.0f} us, at most {:.0f} us'.format(
+            latency_total / seen, latency_max))
+    if len(argv) > 3 and pixels is not None:
+        write_ppm(argv[3], width, height, pixels)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(*sys.argv) or 0)